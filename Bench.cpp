@@ -0,0 +1,269 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 1997-2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Benchmark of move generation, playMove/takeBack, evaluation and
+ * search on a fixed set of positions. Results are printed as one JSON
+ * object per line, for comparing builds (see bench.pro).
+ *
+ * Usage: qenolaba-bench [search depth]
+ */
+
+#include <QElapsedTimer>
+#include <QVector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Board.h"
+#include "EvalScheme.h"
+
+/* start position (0), then positions of computer games: opening,
+ * middle game with contact, pushing, and end game */
+static const char* positions[] = {
+    0,
+    "#15 X   O: 14  X: 14\n"
+    "    / . . . . . \\\n"
+    "   / . O O O O . \\\n"
+    "  / . O O O O O . \\\n"
+    " / . . O O O O O . \\\n"
+    "| . . . . . . . . . |\n"
+    " \\ . X . X X X X . /\n"
+    "  \\ . X X X X X . /\n"
+    "   \\ . X X X X . /\n"
+    "    \\ . . . . . /\n",
+    "#30 O   O: 14  X: 14\n"
+    "    / . . . . . \\\n"
+    "   / . . . . O . \\\n"
+    "  / . O . . O O . \\\n"
+    " / . . O O O O O . \\\n"
+    "| . . . O O O X . . |\n"
+    " \\ . X O X O X . . /\n"
+    "  \\ . . X X X X . /\n"
+    "   \\ X X X X X X /\n"
+    "    \\ . . . . . /\n",
+    "#50 O   O: 14  X: 14\n"
+    "    / . O . O . \\\n"
+    "   / . O O O . . \\\n"
+    "  / . . O X O O O \\\n"
+    " / . . O O X X . . \\\n"
+    "| . . . . . O O X . |\n"
+    " \\ . . X X X O . . /\n"
+    "  \\ . . X X X . . /\n"
+    "   \\ . X X X X . /\n"
+    "    \\ . . . . . /\n",
+    "#50 O   O: 14  X: 14\n"
+    "    / . . . . . \\\n"
+    "   / . O . . . . \\\n"
+    "  / . O O O O O . \\\n"
+    " / . O O O X O . . \\\n"
+    "| . . O O O O X . . |\n"
+    " \\ . . X X X X X . /\n"
+    "  \\ . . X X X X . /\n"
+    "   \\ . X X . X . /\n"
+    "    \\ . . . . . /\n",
+    "#70 O   O: 14  X: 14\n"
+    "    / . . . . . \\\n"
+    "   / . . . . . . \\\n"
+    "  / . O O O O . . \\\n"
+    " / . . O O X O . . \\\n"
+    "| . . O O O O X . . |\n"
+    " \\ . . O X O X X . /\n"
+    "  \\ . . O X X X . /\n"
+    "   \\ . . X X X . /\n"
+    "    \\ . X . X X /\n",
+    "#70 O   O: 11  X: 14\n"
+    "    / . O . X . \\\n"
+    "   / . O O X X X \\\n"
+    "  / . . . . O O . \\\n"
+    " / O . . . X O O O \\\n"
+    "| . . O . . . O . . |\n"
+    " \\ . . X X X . . . /\n"
+    "  \\ . . X X X . . /\n"
+    "   \\ . X X . . . /\n"
+    "    \\ . . . X . /\n",
+    0 };
+
+static int positionCount()
+{
+    int i;
+    for(i=1; positions[i]; i++);
+    return i;
+}
+
+static void setPosition(Board& b, int i)
+{
+    if (positions[i]) {
+	if (!b.setState(positions[i]))
+	    qWarning("Invalid position %d", i);
+    }
+    else
+	b.begin(Board::color1);
+}
+
+/* Sorted samples (time per operation in ns) of all positions */
+class Samples
+{
+public:
+    void add(double ns) { _ns.append(ns); }
+    void sort() { qSort(_ns); }
+    double percentile(int p)
+    { return _ns.isEmpty() ? 0 : _ns[(_ns.size()-1) * p / 100]; }
+
+private:
+    QVector<double> _ns;
+};
+
+static void report(const char* test, Samples& s, double ops, double ms)
+{
+    s.sort();
+    printf("{\"test\": \"%s\", \"ops\": %.0f, \"ops_per_sec\": %.0f, "
+	   "\"median_ns\": %.0f, \"p90_ns\": %.0f, \"p99_ns\": %.0f}\n",
+	   test, ops, (ms > 0) ? ops * 1000.0 / ms : 0,
+	   s.percentile(50), s.percentile(90), s.percentile(99));
+    fflush(stdout);
+}
+
+/* Each sample is the average of a batch of calls, as a single call
+ * is too short to be timed exactly */
+enum { Batches = 200, BatchSize = 50 };
+
+static void benchGenerate()
+{
+    Samples s;
+    double ops = 0, ms = 0;
+    Board b;
+    MoveList list;
+
+    for(int i=0; i<positionCount(); i++) {
+	setPosition(b, i);
+	for(int j=0; j<Batches; j++) {
+	    QElapsedTimer t;
+	    t.start();
+	    for(int k=0; k<BatchSize; k++)
+		b.generateMoves(list);
+	    qint64 ns = t.nsecsElapsed();
+	    s.add((double) ns / BatchSize);
+	    ops += BatchSize;
+	    ms += ns / 1000000.0;
+	}
+    }
+    report("generateMoves", s, ops, ms);
+}
+
+/* playMove/takeBack pairs for all moves of a position */
+static void benchPlayMove()
+{
+    Samples s;
+    double ops = 0, ms = 0;
+    Board b;
+    MoveList list;
+    Move moves[MoveList::MaxMoves], m;
+
+    for(int i=0; i<positionCount(); i++) {
+	int count = 0;
+
+	setPosition(b, i);
+	b.generateMoves(list);
+	while(list.getNext(m, Move::maxMoveType()))
+	    moves[count++] = m;
+	if (count == 0) continue;
+
+	for(int j=0; j<Batches; j++) {
+	    QElapsedTimer t;
+	    t.start();
+	    for(int k=0; k<count; k++) {
+		b.playMove(moves[k]);
+		b.takeBack();
+	    }
+	    qint64 ns = t.nsecsElapsed();
+	    s.add((double) ns / count);
+	    ops += count;
+	    ms += ns / 1000000.0;
+	}
+    }
+    report("playMove/takeBack", s, ops, ms);
+}
+
+static void benchEvaluation()
+{
+    Samples s;
+    double ops = 0, ms = 0;
+    Board b;
+    volatile int sum = 0;
+
+    b.setEvalScheme();
+    for(int i=0; i<positionCount(); i++) {
+	setPosition(b, i);
+	for(int j=0; j<Batches; j++) {
+	    QElapsedTimer t;
+	    t.start();
+	    for(int k=0; k<BatchSize; k++)
+		sum += b.calcEvaluation();
+	    qint64 ns = t.nsecsElapsed();
+	    s.add((double) ns / BatchSize);
+	    ops += BatchSize;
+	    ms += ns / 1000000.0;
+	}
+    }
+    report("calcEvaluation", s, ops, ms);
+}
+
+/* Search of each position with a new board (empty hash table).
+ * Samples are the times per search node */
+static void benchSearch(int depth)
+{
+    Samples s;
+    double nodes = 0, ms = 0;
+    SearchLimits l;
+
+    l.depth = depth;
+    for(int i=0; i<positionCount(); i++) {
+	Board b;
+
+	b.setSpyLevel(0);
+	setPosition(b, i);
+
+	QElapsedTimer t;
+	t.start();
+	Move m = b.bestMove(l);
+	qint64 ns = t.nsecsElapsed();
+
+	printf("{\"test\": \"bestMove\", \"position\": %d, \"depth\": %d, "
+	       "\"move\": \"%s\", \"nodes\": %lld, \"ms\": %.1f}\n",
+	       i, depth, qPrintable(m.name()), (long long) b.nodes(),
+	       ns / 1000000.0);
+	fflush(stdout);
+
+	if (b.nodes() > 0)
+	    s.add((double) ns / b.nodes());
+	nodes += b.nodes();
+	ms += ns / 1000000.0;
+    }
+    report("bestMove", s, nodes, ms);
+}
+
+int main(int argc, char* argv[])
+{
+    int depth = (argc>1) ? atoi(argv[1]) : 4;
+
+    benchGenerate();
+    benchPlayMove();
+    benchEvaluation();
+    benchSearch(depth);
+
+    return 0;
+}
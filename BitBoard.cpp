@@ -0,0 +1,342 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Bitboard representation of a position */
+
+#include "BitBoard.h"
+#include "Board.h"
+
+quint64 BitBoard::fieldBit[AllFields];
+int BitBoard::bitNo[AllFields];
+quint64 BitBoard::boardMask;
+quint64 BitBoard::edge[7][6];
+quint64 BitBoard::inner[7];
+int BitBoard::rot[7];
+bool BitBoard::tablesDone = BitBoard::initTables();
+
+/* fields 11*row+col in the 11x11 array of Board */
+static bool onBoard(int f)
+{
+    int row = f / 11, col = f % 11;
+
+    return (row>0 && row<10 && col>0 && col<10 &&
+	    col-row <= 4 && row-col <= 4);
+}
+
+bool BitBoard::initTables()
+{
+    int f, d, k;
+
+    boardMask = 0;
+    for(f=0;f<AllFields;f++) {
+	fieldBit[f] = 0;
+	bitNo[f] = -1;
+	if (!onBoard(f)) continue;
+	/* x + 13y modulo 61 numbers the hexagon without gaps, with
+	 * x, y being column and row relative to the center field */
+	int x = f % 11 - 5, y = f / 11 - 5;
+	bitNo[f] = ((x + 13*y) % RealFields + RealFields) % RealFields;
+	fieldBit[f] = Q_UINT64_C(1) << bitNo[f];
+	boardMask |= fieldBit[f];
+    }
+    Q_ASSERT( boardMask == (Q_UINT64_C(1) << RealFields) - 1 );
+
+    for(d=1;d<7;d++) {
+	int diff = Board::fieldDiffOfDir(d);
+
+	/* same bit distance for all fields, but the rotation also
+	 * finds neighbours for fields at the edge: mask them out */
+	rot[d] = (bitNo[60+diff] - bitNo[60] + RealFields) % RealFields;
+	inner[d] = 0;
+	for(f=0;f<AllFields;f++)
+	    if (bitNo[f] >= 0 && bitNo[f+diff] >= 0)
+		inner[d] |= fieldBit[f];
+	edge[d][1] = boardMask & ~inner[d];
+
+	for(k=2;k<6;k++)
+	    edge[d][k] = from(edge[d][k-1], d);
+    }
+
+    return true;
+}
+
+/* Move types in the order Board::generateFieldMoves inserts them
+ * for one start field and direction */
+static const Move::MoveType insertOrder[Move::typeCount] = {
+    Move::move1, Move::left2, Move::right2, Move::move2,
+    Move::push1with2, Move::out1with2, Move::left3, Move::right3,
+    Move::move3, Move::push1with3, Move::out1with3, Move::push2,
+    Move::out2 };
+
+enum { move1Rank = 0, left2Rank, right2Rank, move2Rank, push1with2Rank,
+       out1with2Rank, left3Rank, right3Rank, move3Rank, push1with3Rank,
+       out1with3Rank, push2Rank, out2Rank };
+
+/* moves found per start field (bit number) and direction, as bit set
+ * of ranks in insertOrder */
+typedef unsigned short MoveCode[BitBoard::RealFields][7];
+
+static inline void mark(MoveCode& code, quint64 x, int d, int rank)
+{
+    for(;x;x &= x-1)
+	code[BitBoard::firstBit(x)][d] |= 1 << rank;
+}
+
+void BitBoard::generateMoves(int color, const int* order,
+			     MoveList& list) const
+{
+    quint64 own = bits[color-1], opp = bits[2-color];
+    quint64 empty = boardMask & ~(own | opp);
+    quint64 free1[7];   /* neighbour into direction is free */
+    MoveCode code;
+    quint64 x;
+    int d, i;
+
+    list.clear();
+    if (!own) return;
+
+    for(x=own;x;x &= x-1)
+	for(d=1;d<7;d++)
+	    code[firstBit(x)][d] = 0;
+
+    for(d=1;d<7;d++)
+	free1[d] = from(empty, d);
+
+    for(d=1;d<7;d++) {
+	const quint64* out = edge[d];
+	int dl = (d==1) ? 6 : d-1;
+	int dr = (d==6) ? 1 : d+1;
+
+	/* e<k>/p<k>: k-th neighbour is free / opponent.
+	 * Only calculated as far as needed: shifts are expensive */
+	quint64 e1 = free1[d];
+	quint64 o1 = from(own, d);
+	quint64 s2 = own & o1;                      /* (c c ...) */
+	mark(code, own & e1, d, move1Rank);
+	if (!s2) continue;
+
+	/* free neighbours left/right of 2nd field */
+	quint64 l2 = from(free1[dl], d), r2 = from(free1[dr], d);
+	quint64 left2 = s2 & free1[dl] & l2, right2 = s2 & free1[dr] & r2;
+	quint64 e2 = from(e1, d), e3 = 0;
+	quint64 p2 = from(from(opp, d), d);
+	quint64 s2p = s2 & p2;                      /* (c c o ...) */
+	quint64 s3 = s2 & from(o1, d);              /* (c c c ...) */
+
+	mark(code, left2, d, left2Rank);
+	mark(code, right2, d, right2Rank);
+	mark(code, s2 & e2, d, move2Rank);
+	if (s2p) {
+	    e3 = from(e2, d);
+	    mark(code, s2p & e3, d, push1with2Rank);
+	    mark(code, s2p & out[3], d, out1with2Rank);
+	}
+	if (!s3) continue;
+
+	if (left2 & s3)
+	    mark(code, left2 & s3 & from(l2, d), d, left3Rank);
+	if (right2 & s3)
+	    mark(code, right2 & s3 & from(r2, d), d, right3Rank);
+	if (!s2p) e3 = from(e2, d);
+	mark(code, s3 & e3, d, move3Rank);
+
+	quint64 p3 = from(p2, d);
+	quint64 s3p = s3 & p3;                      /* (c c c o ...) */
+	if (!s3p) continue;
+
+	quint64 e4 = from(e3, d);
+	mark(code, s3p & e4, d, push1with3Rank);
+	mark(code, s3p & out[4], d, out1with3Rank);
+
+	quint64 s3pp = s3p & from(p3, d);          /* (c c c o o ...) */
+	if (!s3pp) continue;
+
+	mark(code, s3pp & from(e4, d), d, push2Rank);
+	mark(code, s3pp & out[5], d, out2Rank);
+    }
+
+    /* insert in same order as Board::generateFieldMoves */
+    for(i=0;i<RealFields;i++) {
+	int f = order[i];
+	if (!(own & fieldBit[f])) continue;
+
+	const unsigned short* c = code[bitNo[f]];
+	for(d=1;d<7;d++)
+	    for(int r = c[d]; r; r &= r-1)
+		list.insert(f, d, insertOrder[firstBit(r)]);
+    }
+}
+
+#ifdef BITBOARD_TEST
+
+/* Check that bitboard move generation gives the same moves as walking
+ * the field array, for all positions reachable within some depth
+ * (perft style). Build with DEFINES += BITBOARD BITBOARD_TEST.
+ *
+ * Usage: bitboardtest [depth]
+ */
+
+#include <QElapsedTimer>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* start position and some positions with pushing/out moves */
+static const char* positions[] = {
+    0,
+    "#20 O   O: 13  X: 12\n"
+    "    / . . O O . \\\n"
+    "   / . O O X X . \\\n"
+    "  / . . O O X X . \\\n"
+    " / . . O O X X O . \\\n"
+    "| . O O X X X O O . |\n"
+    " \\ . O X X O O . . /\n"
+    "  \\ X X O O . . . /\n"
+    "   \\ X X . O . . /\n"
+    "    \\ X . . . . /\n",
+    "#41 X   O: 10  X: 11\n"
+    "    / X X O . . \\\n"
+    "   / O O O X . . \\\n"
+    "  / . . . X O . . \\\n"
+    " / . . X X O O . . \\\n"
+    "| . . . O X X X O . |\n"
+    " \\ X X O . . O O O /\n"
+    "  \\ . O . . X . . /\n"
+    "   \\ . . . . X . /\n"
+    "    \\ . . O X X /\n",
+    0 };
+
+static int errors = 0;
+
+static bool sameMoves(MoveList& l1, MoveList& l2)
+{
+    Move m1, m2;
+
+    while(1) {
+	bool more1 = l1.getNext(m1, Move::maxMoveType());
+	bool more2 = l2.getNext(m2, Move::maxMoveType());
+	if (more1 != more2) return false;
+	if (!more1) return true;
+	if (m1.field != m2.field || m1.direction != m2.direction ||
+	    m1.type != m2.type) return false;
+    }
+}
+
+/* returns number of leaf positions */
+static quint64 perft(Board& b, int depth)
+{
+    MoveList l1, l2;
+    Move m;
+    quint64 count = 0;
+
+    b.generateMoves(l1);
+    b.generateMovesByFields(l2);
+    if (!sameMoves(l1, l2)) {
+	if (errors++ < 5) {
+	    qDebug("Move generation differs in position\n%s",
+		   qPrintable(b.getState()));
+	}
+    }
+    if (depth == 0) return 1;
+
+    b.generateMoves(l1);
+    while(l1.getNext(m, Move::maxMoveType())) {
+	b.playMove(m);
+	if (b.isValid())
+	    count += perft(b, depth-1);
+	else
+	    count++;
+	b.takeBack();
+    }
+    return count;
+}
+
+/* time generation of all moves in positions reachable in <depth>.
+ * Per position, both generators are run alternately a few times,
+ * taking the fastest run: this is less disturbed by other load */
+static void timeGenerators(Board& b, int depth, double& ns1, double& ns2,
+			   int& positions)
+{
+    MoveList list;
+    Move m;
+    QElapsedTimer t;
+    qint64 min1 = -1, min2 = -1;
+
+    for(int r=0;r<10;r++) {
+	t.start();
+	for(int i=0;i<20;i++)
+	    b.generateMovesByFields(list);
+	qint64 n1 = t.nsecsElapsed();
+	t.start();
+	for(int i=0;i<20;i++)
+	    b.generateMoves(list);
+	qint64 n2 = t.nsecsElapsed();
+	if (min1 < 0 || n1 < min1) min1 = n1;
+	if (min2 < 0 || n2 < min2) min2 = n2;
+    }
+    ns1 += min1 / 20.0;
+    ns2 += min2 / 20.0;
+    positions++;
+
+    if (depth == 0) return;
+
+    b.generateMoves(list);
+    while(list.getNext(m, Move::maxMoveType())) {
+	b.playMove(m);
+	if (b.isValid())
+	    timeGenerators(b, depth-1, ns1, ns2, positions);
+	b.takeBack();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int depth = (argc>1) ? atoi(argv[1]) : 3;
+    int i, d;
+    Board b;
+
+    for(i=0; i==0 || positions[i]; i++) {
+	if (positions[i])
+	    b.setState(positions[i]);
+	else
+	    b.begin(Board::color1);
+
+	printf("Position %d:\n", i);
+	for(d=1;d<=depth;d++) {
+	    QElapsedTimer t;
+	    t.start();
+	    quint64 count = perft(b, d);
+	    printf("  perft(%d) = %llu  (%d ms)\n",
+		   d, (unsigned long long) count, (int) t.elapsed());
+	}
+
+	int positions = 0;
+	double ns1 = 0, ns2 = 0;
+	timeGenerators(b, 1, ns1, ns2, positions);
+	printf("  generateMoves: fields %.0f ns, bitboard %.0f ns\n",
+	       ns1 / positions, ns2 / positions);
+    }
+
+    if (errors>0)
+	printf("FAILED: %d positions with different moves\n", errors);
+    else
+	printf("OK: same moves in all positions\n");
+
+    return (errors>0) ? 1 : 0;
+}
+
+#endif // BITBOARD_TEST
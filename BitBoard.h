@@ -0,0 +1,99 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Bitboard representation of a position
+ *
+ * The 61 fields of the board are numbered such that the neighbour
+ * into a direction always is a fixed distance away modulo 61, giving
+ * one 64-bit word per color. Neighbours into one of the 6 directions
+ * (see Board::fieldDiffOfDir) are found for all fields at once by
+ * rotating the lower 61 bits, masking out fields at the edge.
+ *
+ * Used by Board for move generation if compiled with BITBOARD
+ * (qmake CONFIG+=bitboard).
+ */
+
+#ifndef _BITBOARD_H_
+#define _BITBOARD_H_
+
+#include <QtGlobal>
+#include "Move.h"
+
+class BitBoard
+{
+public:
+    BitBoard() { clear(); }
+
+    /* same as in Board */
+    enum { AllFields = 121, RealFields = 61 };
+
+    void clear() { bits[0] = bits[1] = 0; }
+
+    /* set field <f> (index into 11x11 array of Board) to
+     * Board value <v>: only color1 (1) and color2 (2) are stored */
+    void set(int f, int v)
+    {
+	quint64 m = fieldBit[f];
+	bits[0] &= ~m;
+	bits[1] &= ~m;
+	if (v == 1) bits[0] |= m;
+	else if (v == 2) bits[1] |= m;
+    }
+
+    quint64 stones(int color) const { return bits[color-1]; }
+
+    /* Moves of <color>, visiting the fields in <order>.
+     * Generates the same moves in same order as Board does */
+    void generateMoves(int color, const int* order, MoveList& list) const;
+
+    /* Fields whose neighbour into direction <d> is in <x> */
+    static quint64 from(quint64 x, int d)
+    {
+	return ((x >> rot[d]) | (x << (RealFields - rot[d]))) & inner[d];
+    }
+
+    static quint64 bit(int f) { return fieldBit[f]; }
+
+    /* number of lowest bit set in <x> (x != 0) */
+    static int firstBit(quint64 x)
+    {
+#ifdef __GNUC__
+	return __builtin_ctzll(x);
+#else
+	int n = 0;
+	while(!(x & 1)) { x >>= 1; n++; }
+	return n;
+#endif
+    }
+
+private:
+    static bool initTables();
+
+    quint64 bits[2];
+
+    static quint64 fieldBit[AllFields];  /* 0 for fields not on board */
+    static int bitNo[AllFields];         /* -1 for fields not on board */
+    static quint64 boardMask;
+    static quint64 edge[7][6];     /* k-th neighbour is off board */
+    static quint64 inner[7];       /* neighbour is on board */
+    static int rot[7];             /* bit distance to neighbour */
+    static bool tablesDone;
+};
+
+#endif /* _BITBOARD_H_ */
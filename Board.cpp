@@ -25,8 +25,12 @@
 
 #include "Board.h"
 #include "EvalScheme.h"
+#include "TransTable.h"
+#include "BitBoard.h"
+#include "OpeningBook.h"
 
 #include <QDateTime>
+#include <QThread>
 
 // #define MYTRACE 1
 
@@ -37,8 +41,15 @@
 #endif
 
 
-static int ratedPositions, wonPositions, searchCalled, moveCount;
-static int normalCount, pushCount, outCount, cutoffCount;
+/*********************** Class SearchStats ********************************/
+
+void SearchStats::clear()
+{
+    ratedPositions = wonPositions = 0;
+    searchCalled = moveCount = 0;
+    normalCount = pushCount = outCount = 0;
+    cutoffCount = hashHits = 0;
+}
 
 /*********************** Class PrincipalVariation *************************/
 
@@ -65,7 +76,35 @@ void PrincipalVariation::update(int d, Move& m)
     move[d][d]=m;
 }
 
+/* combination ends with <m> at depth <d> (e.g. from hash table) */
+void PrincipalVariation::setLast(int d, const Move& m)
+{
+    int i;
+
+    if (d>actMaxDepth) return;
+    for(i=d+1;i<=actMaxDepth;i++)
+	move[d][i].type = Move::none;
+    move[d][d]=m;
+}
+
+
+
+/*********************** Class SearchContext ******************************/
 
+SearchContext::SearchContext()
+{
+    breakOut = false;
+    inPrincipalVariation = false;
+    maxDepth = depthLimit = 1;
+    reduction = 0;
+    afterNull = false;
+    spyDepth = 0;
+    softLimit = hardLimit = 0;
+    pondering = false;
+    ponderTime = 0;
+    nodes = nodeLimit = 0;
+    callback = 0;
+}
 
 /****************************** Class Board ****************************/
 
@@ -94,6 +133,18 @@ int Board::order[]={
     64,75,86,97,108,107,106,105,104,92,80,68,56,45,34,23,12,
     13,14,15,16,28,40,52 };
 
+bool Board::initRingIndex()
+{
+    for(int f=0;f<AllFields;f++)
+	ringIndex[f] = -1;
+    for(int i=0;i<RealFields;i++)
+	ringIndex[order[i]] = i;
+    return true;
+}
+
+int Board::ringIndex[AllFields];
+bool Board::ringIndexDone = Board::initRingIndex();
+
 /* See EvalScheme.{h|cpp}
  *
   // Ratings for fields are calculated out of these values
@@ -112,25 +163,107 @@ int Board::order[]={
   int Board::inARowValue[]= { 2, 5, 4, 3 };
 */
 
-int Board::fieldValue[61];
 int Board::direction[]= { -11,1,12,11,-1,-12,-11,1 };
 
+/* SplitMix64 pseudo random number generator */
+static quint64 nextRandom(quint64& s)
+{
+    quint64 z = (s += Q_UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/* Keys are generated with a fixed seed: the hash key of a position
+ * has to be the same in every program run */
+quint64 Board::initZobrist()
+{
+    quint64 seed = 0;
+
+    for(int c=0;c<2;c++)
+	for(int f=0;f<AllFields;f++)
+	    zobrist[c][f] = nextRandom(seed);
+
+    return nextRandom(seed);
+}
+
+quint64 Board::zobrist[2][AllFields];
+quint64 Board::zobristColor = Board::initZobrist();
+
 
 Board::Board()
 {
+    color = color1;
+    _evalScheme = 0;
+    for(int i=0;i<RealFields;i++)
+	fieldValue[i] = 0;
     clear();
-    breakOut = bUpdateSpy = false;
     spyLevel = 1;
-    spyDepth = 0;
     debug = 0;
     realMaxDepth = 1;
+    _transTable = 0;
+    _book = 0;
+    _hashSize = TransTable::defaultSize;
+    _threads = 1;
+    _nullReduction = 2;
+    _nullVerify = false;
+    _lmrMoves = 4;
+    _deterministic = false;
+    _seed = 0;
+    _isHelper = false;
+}
+
+Board::Board(const Board& b)
+{
     _evalScheme = 0;
+    _transTable = 0;
+    _isHelper = false;
+    *this = b;
+}
+
+Board& Board::operator=(const Board& b)
+{
+    if (this == &b) return *this;
+
+    _evalScheme = b._evalScheme;
+    for(int i=0;i<RealFields;i++)
+	fieldValue[i] = b.fieldValue[i];
+    setPosition(b);
+
+    debug = b.debug;
+    spyLevel = b.spyLevel;
+    realMaxDepth = b.realMaxDepth;
+    _book = b._book;
+    _hashSize = b._hashSize;
+    _threads = b._threads;
+    _nullReduction = b._nullReduction;
+    _nullVerify = b._nullVerify;
+    _lmrMoves = b._lmrMoves;
+    _deterministic = b._deterministic;
+    _seed = b._seed;
+
+    return *this;
+}
+
+Board::~Board()
+{
+    delete _transTable;
+}
+
+void Board::setHashSize(int mb)
+{
+    _hashSize = mb;
+    if (_transTable)
+	_transTable->setSize(mb);
 }
 
 void Board::setEvalScheme(EvalScheme* scheme)
 {
-    if (!scheme)
-	scheme = new EvalScheme( QString("Default") );
+    if (!scheme) {
+	/* shared by all boards, never changed */
+	static EvalScheme defaultScheme( QString("Default") );
+	scheme = &defaultScheme;
+    }
 
     _evalScheme = scheme;
     setFieldValues();
@@ -158,6 +291,7 @@ void Board::setFieldValues()
 	fieldValue[i] = ringValue[3] + ((j+=k) % ringDiff[3]);
     for(i=37;i<61;i++)
 	fieldValue[i] = ringValue[4] + ((j+=k) % ringDiff[4]);
+    calcFieldSums();
 }
 
 
@@ -172,6 +306,7 @@ void Board::begin(int startColor)
     color = startColor;
     color1Count = color2Count = 14;
     moveNo = 0;
+    fieldsChanged();
 }
 
 void Board::clear()
@@ -183,6 +318,69 @@ void Board::clear()
     storedFirst = storedLast = 0;
     color1Count = color2Count = 0;
     moveNo = 0;
+    fieldsChanged();
+}
+
+void Board::setPosition(const Board& b)
+{
+    int i;
+
+    for(i=0;i<AllFields;i++)
+	field[i] = b.field[i];
+    for(i=0;i<MvsStored;i++)
+	storedMove[i] = b.storedMove[i];
+    storedFirst = b.storedFirst;
+    storedLast = b.storedLast;
+    color1Count = b.color1Count;
+    color2Count = b.color2Count;
+    color = b.color;
+    moveNo = b.moveNo;
+    _hashKey = b._hashKey;
+#ifdef BITBOARD
+    _bits = b._bits;
+#endif
+    /* field values of <b> may differ */
+    calcFieldSums();
+}
+
+quint64 Board::calcHashKey()
+{
+    quint64 key = (color == color2) ? zobristColor : 0;
+
+    for(int f=0;f<RealFields;f++)
+	key ^= zobristKey(order[f], field[order[f]]);
+
+    return key;
+}
+
+void Board::fieldsChanged()
+{
+    _hashKey = calcHashKey();
+#ifdef BITBOARD
+    for(int f=0;f<AllFields;f++)
+	_bits.set(f, field[f]);
+#endif
+    calcFieldSums();
+}
+
+void Board::calcFieldSums()
+{
+    _fieldSum[0] = _fieldSum[1] = 0;
+    _stones[0] = _stones[1] = 0;
+
+    for(int i=0;i<RealFields;i++) {
+	int j = field[order[i]];
+	if (j != color1 && j != color2) continue;
+	_fieldSum[j-1] += fieldValue[i];
+	_stones[j-1] |= Q_UINT64_C(1) << i;
+    }
+}
+
+void Board::setActColor(int c)
+{
+    if ((c == color2) != (color == color2))
+	_hashKey ^= zobristColor;
+    color = c;
 }
 
 /* generate moves starting at field <startField> */
@@ -308,6 +506,15 @@ void Board::generateFieldMoves(int startField, MoveList& list)
 
 
 void Board::generateMoves(MoveList& list)
+{
+#ifdef BITBOARD
+    _bits.generateMoves(color, order, list);
+#else
+    generateMovesByFields(list);
+#endif
+}
+
+void Board::generateMovesByFields(MoveList& list)
 {
     int actField, f;
 
@@ -339,7 +546,7 @@ void Board::playMove(const Move& m)
     f = m.field;
     CHECK( (m.type >= 0) && (m.type < Move::none));
     CHECK( field[f] == color );
-    field[f] = free;
+    put(f, free);
     dir = direction[m.direction];
 
     switch(m.type) {
@@ -349,31 +556,31 @@ void Board::playMove(const Move& m)
 	CHECK( field[f + 3*dir] == opponent );
 	CHECK( field[f + 4*dir] == opponent );
 	CHECK( field[f + 5*dir] == out );
-	field[f + 3*dir] = color;
+	put(f + 3*dir, color);
 	break;
     case Move::out1with3:   /* (c c c o |)   */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == opponent );
 	CHECK( field[f + 4*dir] == out );
-	field[f + 3*dir] = color;
+	put(f + 3*dir, color);
 	break;
     case Move::move3:       /* (c c c .)     */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == free );
-	field[f + 3*dir] = color;
+	put(f + 3*dir, color);
 	break;
     case Move::out1with2:   /* (c c o |)     */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == opponent );
 	CHECK( field[f + 3*dir] == out );
-	field[f + 2*dir] = color;
+	put(f + 2*dir, color);
 	break;
     case Move::move2:       /* (c c .)       */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == free );
-	field[f + 2*dir] = color;
+	put(f + 2*dir, color);
 	break;
     case Move::push2:       /* (c c c o o .) */
 	CHECK( field[f + dir] == color );
@@ -381,8 +588,8 @@ void Board::playMove(const Move& m)
 	CHECK( field[f + 3*dir] == opponent );
 	CHECK( field[f + 4*dir] == opponent );
 	CHECK( field[f + 5*dir] == free );
-	field[f + 3*dir] = color;
-	field[f + 5*dir] = opponent;
+	put(f + 3*dir, color);
+	put(f + 5*dir, opponent);
 	break;
     case Move::left3:
 	dir2 = direction[m.direction-1];
@@ -391,11 +598,11 @@ void Board::playMove(const Move& m)
 	CHECK( field[f + dir2] == free );
 	CHECK( field[f + dir+dir2] == free );
 	CHECK( field[f + 2*dir+dir2] == free );
-	field[f+dir2] = color;
-	field[f+=dir] = free;
-	field[f+dir2] = color;
-	field[f+=dir] = free;
-	field[f+dir2] = color;
+	put(f+dir2, color);
+	put(f+=dir, free);
+	put(f+dir2, color);
+	put(f+=dir, free);
+	put(f+dir2, color);
 	break;
     case Move::right3:
 	dir2 = direction[m.direction+1];
@@ -404,48 +611,48 @@ void Board::playMove(const Move& m)
 	CHECK( field[f + dir2] == free );
 	CHECK( field[f + dir+dir2] == free );
 	CHECK( field[f + 2*dir+dir2] == free );
-	field[f+dir2] = color;
-	field[f+=dir] = free;
-	field[f+dir2] = color;
-	field[f+=dir] = free;
-	field[f+dir2] = color;
+	put(f+dir2, color);
+	put(f+=dir, free);
+	put(f+dir2, color);
+	put(f+=dir, free);
+	put(f+dir2, color);
 	break;
     case Move::push1with3:   /* (c c c o .) => (. c c c o) */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == opponent );
 	CHECK( field[f + 4*dir] == free );
-	field[f + 3*dir] = color;
-	field[f + 4*dir] = opponent;
+	put(f + 3*dir, color);
+	put(f + 4*dir, opponent);
 	break;
     case Move::push1with2:   /* (c c o .) => (. c c o) */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == opponent );
 	CHECK( field[f + 3*dir] == free );
-	field[f + 2*dir] = color;
-	field[f + 3*dir] = opponent;
+	put(f + 2*dir, color);
+	put(f + 3*dir, opponent);
 	break;
     case Move::left2:
 	dir2 = direction[m.direction-1];
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + dir2] == free );
 	CHECK( field[f + dir+dir2] == free );
-	field[f+dir2] = color;
-	field[f+=dir] = free;
-	field[f+dir2] = color;
+	put(f+dir2, color);
+	put(f+=dir, free);
+	put(f+dir2, color);
 	break;
     case Move::right2:
 	dir2 = direction[m.direction+1];
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + dir2] == free );
 	CHECK( field[f + dir+dir2] == free );
-	field[f+dir2] = color;
-	field[f+=dir] = free;
-	field[f+dir2] = color;
+	put(f+dir2, color);
+	put(f+=dir, free);
+	put(f+dir2, color);
 	break;
     case Move::move1:       /* (c .) => (. c) */
 	CHECK( field[f + dir] == free );
-	field[f + dir] = color;
+	put(f + dir, color);
 	break;
     default:
 	break;
@@ -460,6 +667,7 @@ void Board::playMove(const Move& m)
 
     /* change actual color */
     color = opponent;
+    _hashKey ^= zobristColor;
     moveNo++;
 
     CHECK( isConsistent() );
@@ -477,6 +685,7 @@ bool Board::takeBack()
 
     /* change actual color */
     color = (color == color1) ? color2:color1;
+    _hashKey ^= zobristColor;
     moveNo--;
 
     if (m.isOutMove()) {
@@ -488,7 +697,7 @@ bool Board::takeBack()
 
     f = m.field;
     CHECK( field[f] == free );
-    field[f] = color;
+    put(f, color);
     dir = direction[m.direction];
 
     switch(m.type) {
@@ -498,31 +707,31 @@ bool Board::takeBack()
 	CHECK( field[f + 3*dir] == color );
 	CHECK( field[f + 4*dir] == opponent );
 	CHECK( field[f + 5*dir] == out );
-	field[f + 3*dir] = opponent;
+	put(f + 3*dir, opponent);
 	break;
     case Move::out1with3:   /* (. c c c |) => (c c c o |) */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == color );
 	CHECK( field[f + 4*dir] == out );
-	field[f + 3*dir] = opponent;
+	put(f + 3*dir, opponent);
 	break;
     case Move::move3:       /* (. c c c) => (c c c .)     */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == color );
-	field[f + 3*dir] = free;
+	put(f + 3*dir, free);
 	break;
     case Move::out1with2:   /* (. c c | ) => (c c o |)     */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == out );
-	field[f + 2*dir] = opponent;
+	put(f + 2*dir, opponent);
 	break;
     case Move::move2:       /* (. c c) => (c c .)       */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
-	field[f + 2*dir] = free;
+	put(f + 2*dir, free);
 	break;
     case Move::push2:       /* (. c c c o o) => (c c c o o .) */
 	CHECK( field[f + dir] == color );
@@ -530,8 +739,8 @@ bool Board::takeBack()
 	CHECK( field[f + 3*dir] == color );
 	CHECK( field[f + 4*dir] == opponent );
 	CHECK( field[f + 5*dir] == opponent );
-	field[f + 3*dir] = opponent;
-	field[f + 5*dir] = free;
+	put(f + 3*dir, opponent);
+	put(f + 5*dir, free);
 	break;
     case Move::left3:
 	dir2 = direction[m.direction-1];
@@ -540,11 +749,11 @@ bool Board::takeBack()
 	CHECK( field[f + dir2] == color );
 	CHECK( field[f + dir+dir2] == color );
 	CHECK( field[f + 2*dir+dir2] == color );
-	field[f+dir2] = free;
-	field[f+=dir] = color;
-	field[f+dir2] = free;
-	field[f+=dir] = color;
-	field[f+dir2] = free;
+	put(f+dir2, free);
+	put(f+=dir, color);
+	put(f+dir2, free);
+	put(f+=dir, color);
+	put(f+dir2, free);
 	break;
     case Move::right3:
 	dir2 = direction[m.direction+1];
@@ -553,48 +762,48 @@ bool Board::takeBack()
 	CHECK( field[f + dir2] == color );
 	CHECK( field[f + dir+dir2] == color );
 	CHECK( field[f + 2*dir+dir2] == color );
-	field[f+dir2] = free;
-	field[f+=dir] = color;
-	field[f+dir2] = free;
-	field[f+=dir] = color;
-	field[f+dir2] = free;
+	put(f+dir2, free);
+	put(f+=dir, color);
+	put(f+dir2, free);
+	put(f+=dir, color);
+	put(f+dir2, free);
 	break;
     case Move::push1with3:   /* (. c c c o) => (c c c o .) */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == color );
 	CHECK( field[f + 4*dir] == opponent );
-	field[f + 3*dir] = opponent;
-	field[f + 4*dir] = free;
+	put(f + 3*dir, opponent);
+	put(f + 4*dir, free);
 	break;
     case Move::push1with2:   /* (. c c o) => (c c o .) */
 	CHECK( field[f + dir] == color );
 	CHECK( field[f + 2*dir] == color );
 	CHECK( field[f + 3*dir] == opponent );
-	field[f + 2*dir] = opponent;
-	field[f + 3*dir] = free;
+	put(f + 2*dir, opponent);
+	put(f + 3*dir, free);
 	break;
     case Move::left2:
 	dir2 = direction[m.direction-1];
 	CHECK( field[f + dir] == free );
 	CHECK( field[f + dir2] == color );
 	CHECK( field[f + dir+dir2] == color );
-	field[f+dir2] = free;
-	field[f+=dir] = color;
-	field[f+dir2] = free;
+	put(f+dir2, free);
+	put(f+=dir, color);
+	put(f+dir2, free);
 	break;
     case Move::right2:
 	dir2 = direction[m.direction+1];
 	CHECK( field[f + dir] == free );
 	CHECK( field[f + dir2] == color );
 	CHECK( field[f + dir+dir2] == color );
-	field[f+dir2] = free;
-	field[f+=dir] = color;
-	field[f+dir2] = free;
+	put(f+dir2, free);
+	put(f+=dir, color);
+	put(f+dir2, free);
 	break;
     case Move::move1:       /* (. c) => (c .) */
 	CHECK( field[f + dir] == color );
-	field[f + dir] = free;
+	put(f + dir, free);
 	break;
     default:
 	break;
@@ -814,7 +1023,7 @@ int Board::validState()
 
 #ifdef MYTRACE
     if (spyLevel>2) {
-	indent(spyDepth);
+	indent(_ctx.spyDepth);
 	qDebug("Valid: %s (Color1 %d, Color2 %d, moveCount of %d: %d)\n",
 	       (res == empty) ? "empty" : (res==valid) ? "valid":"invalid",
 	       c1,c2,color,moveCount);
@@ -837,8 +1046,6 @@ int Board::calcEvaluation()
     MoveTypeCounter tcColor, tcOpponent;
     InARowCounter  ccColor, ccOpponent;
 
-    int f,i,j;
-
     // if not yet set, use default scheme
     if (!_evalScheme) setEvalScheme();
 
@@ -854,19 +1061,16 @@ int Board::calcEvaluation()
 	valueSum = (color==color2) ? 16000 : -16000;
     else {
 
-	/* Calculate fieldValueSum and count move types and connectivity */
-	for(i=0;i<RealFields;i++) {
-	    j=field[f=order[i]];
-	      if (j == free) continue;
-	      if (j == color) {
-		countFrom( f, j, tcColor, ccColor );
-		fieldValueSum -= fieldValue[i];
-	    }
-	    else {
-	    countFrom( f, j, tcOpponent, ccOpponent );
-	    fieldValueSum += fieldValue[i];
-	}
-	}
+	/* fieldValueSum is kept up to date by put(), only
+	 * move types and connectivity are counted here */
+	int opponent = (color == color1) ? color2 : color1;
+	fieldValueSum = _fieldSum[opponent-1] - _fieldSum[color-1];
+
+	for(quint64 s = _stones[color-1]; s; s &= s-1)
+	    countFrom( order[BitBoard::firstBit(s)], color, tcColor, ccColor );
+	for(quint64 s = _stones[opponent-1]; s; s &= s-1)
+	    countFrom( order[BitBoard::firstBit(s)], opponent,
+		       tcOpponent, ccOpponent );
 
 	/* If color can't do any moves, opponent wins... */
 	if (tcColor.sum() == 0)
@@ -895,7 +1099,7 @@ int Board::calcEvaluation()
 
 #ifdef MYTRACE
     if (spyLevel>2) {
-	indent(spyDepth);
+	indent(_ctx.spyDepth);
 	qDebug("Eval %d (field %d, move %d, inARow %d, stone %d)\n",
 	       valueSum, fieldValueSum, moveValueSum,
 	       inARowValueSum, stoneValueSum );
@@ -943,6 +1147,8 @@ void Board::changeEvaluation()
     for(i=37;i<60;i++)
 	fieldValue[i] = fieldValue[i+1];
     fieldValue[60] = tmp;
+
+    calcFieldSums();
 }
 
 /*
@@ -974,18 +1180,46 @@ void Board::showHist()
 int Board::search(int depth, int alpha, int beta)
 {
     int actValue= -14999+depth, value;
-    Move m;
+    int oldAlpha = alpha;
+    int depthLeft = _ctx.maxDepth - depth - _ctx.reduction;
+    Move m, hashMove, best;
     MoveList list;
     bool depthPhase, doDepthSearch;
-
-    searchCalled++;
-
-    /* We make a depth search for the following move types... */
-    int maxType = (depth < maxDepth-1)  ? Move::maxMoveType() :
-					  (depth < maxDepth)    ? Move::maxPushType() :
-								  Move::maxOutType();
+    int moveCount = 0, r;
+    TransEntry e;
+
+    _ctx.stats.searchCalled++;
+    _ctx.nodes++;
+
+    /* Stop if running out of time, but only with a move found */
+    if (limitReached() && (_ctx.bestMove.type != Move::none))
+	_ctx.breakOut = true;
+
+    /* Was this position already searched deep enough? */
+    if (_transTable->probe(_hashKey, e)) {
+	hashMove = e.move;
+
+	if (depth>0 && e.depth >= depthLeft) {
+	    value = e.value;
+	    /* won positions are stored relative to this node */
+	    if (value > 14900) value -= depth;
+	    else if (value < -14900) value += depth;
+
+	    if ((e.bound == TransEntry::exact) ||
+		(e.bound == TransEntry::lower && value >= beta) ||
+		(e.bound == TransEntry::upper && value <= alpha)) {
+		_ctx.stats.hashHits++;
+		_ctx.pv.setLast(depth, hashMove);
+		return value;
+	    }
+	}
+    }
 
     generateMoves(list);
+    list.setOrder(&_ctx.moveOrder, depth);
+
+    if (nullMoveCutoff(depth, depthLeft, beta, list.getLength(), value))
+	return value;
 
 #ifdef MYTRACE
 
@@ -998,9 +1232,9 @@ int Board::search(int depth, int alpha, int beta)
     int oldOutCount;
     int oldCutoffCount;
 
-    spyDepth = depth;
+    _ctx.spyDepth = depth;
 
-    moveCount += list.getLength();
+    _ctx.stats.moveCount += list.getLength();
 
     /*
 	  if (spyLevel>1) {
@@ -1014,26 +1248,32 @@ int Board::search(int depth, int alpha, int beta)
 #endif
 
     /* check for a old best move in main combination */
-    if (inPrincipalVariation) {
-	m = pv[depth];
+    if (_ctx.inPrincipalVariation) {
+	m = _ctx.pv[depth];
 
 	if ((m.type != Move::none) &&
 	    (!list.isElement(m, 0, true)))
 	    m.type = Move::none;
 
 	if (m.type == Move::none)
-	    inPrincipalVariation = false;
+	    _ctx.inPrincipalVariation = false;
 
 #ifdef MYTRACE
 	else {
 	    if (spyLevel>1) {
-		indent(spyDepth);
+		indent(_ctx.spyDepth);
 		qDebug("Got from pv !\n" );
 	    }
 	}
 #endif
     }
 
+    /* otherwise, start with best move found in transposition table */
+    if ((m.type == Move::none) && (hashMove.type != Move::none)) {
+	if (list.isElement(hashMove, 0, true))
+	    m = hashMove;
+    }
+
     // first, play all moves with depth search
     depthPhase = true;
 
@@ -1042,40 +1282,35 @@ int Board::search(int depth, int alpha, int beta)
 	// get next move
 	if (m.type == Move::none) {
 	    if (depthPhase)
-		depthPhase = list.getNext(m, maxType);
+		depthPhase = list.getNext(m, Move::maxMoveType());
 	    if (!depthPhase)
 		if (!list.getNext(m, Move::none)) break;
 	}
-	// we could start with a non-depth move from principal variation
-	doDepthSearch = depthPhase && (m.type <= maxType);
+	doDepthSearch = depthPhase;
 
 #ifdef MYTRACE
 
-	if (m.isOutMove()) outCount++;
-	else if (m.isPushMove()) pushCount++;
-	else normalCount++;
+	if (m.isOutMove()) _ctx.stats.outCount++;
+	else if (m.isPushMove()) _ctx.stats.pushCount++;
+	else _ctx.stats.normalCount++;
 
 	if (doDepthSearch) {
-	    oldRatedPositions = ratedPositions;
-	    oldWonPositions = wonPositions;
-	    oldSearchCalled = searchCalled;
-	    oldMoveCount = moveCount;
-	    oldNormalCount = normalCount;
-	    oldPushCount = pushCount;
-	    oldOutCount = outCount;
-	    oldCutoffCount = cutoffCount;
+	    oldRatedPositions = _ctx.stats.ratedPositions;
+	    oldWonPositions = _ctx.stats.wonPositions;
+	    oldSearchCalled = _ctx.stats.searchCalled;
+	    oldMoveCount = _ctx.stats.moveCount;
+	    oldNormalCount = _ctx.stats.normalCount;
+	    oldPushCount = _ctx.stats.pushCount;
+	    oldOutCount = _ctx.stats.outCount;
+	    oldCutoffCount = _ctx.stats.cutoffCount;
 
 	    if (spyLevel>1) {
-		indent(spyDepth);
+		indent(_ctx.spyDepth);
 		qDebug("%s [%6d .. %6d] ",
 		       (color==color1)?"O":"X", alpha,beta);
 		m.print();
 		qDebug("\n");
 	    }
-
-#ifdef SPION
-	    if (bUpdateSpy) emit update(depth, 0, m, false);
-#endif
 	}
 #endif
 
@@ -1085,7 +1320,7 @@ int Board::search(int depth, int alpha, int beta)
 	    value = 14999-depth;
 	    //  value = ((depth < maxDepth) ? 15999:14999) - depth;
 #ifdef MYTRACE
-	    wonPositions++;
+	    _ctx.stats.wonPositions++;
 #endif
 	}
 	else {
@@ -1094,44 +1329,61 @@ int Board::search(int depth, int alpha, int beta)
 		/* opponent searches for his maximum; but we want the
 	       * minimum: so change sign (for alpha/beta window too!)
 	       */
-		value = - search(depth+1,-beta,-alpha);
+		if (moveCount == 0)
+		    value = - searchChild(depth, depthLeft, -beta, -alpha);
+		else {
+		    /* Principal variation search: with good move ordering,
+		     * later moves only have to be shown not to beat alpha,
+		     * using a zero window (reduced for late quiet moves) */
+		    r = lateMoveReduction(m, depth, depthLeft, moveCount);
+		    _ctx.reduction += r;
+		    value = - searchChild(depth, depthLeft-r, -alpha-1, -alpha);
+		    _ctx.reduction -= r;
+		    if (r > 0 && value > alpha)
+			value = - searchChild(depth, depthLeft,
+					      -alpha-1, -alpha);
+		    /* beats alpha: search again for exact value */
+		    if (value > alpha && value < beta)
+			value = - searchChild(depth, depthLeft, -beta, -alpha);
+		}
 	    }
 	    else {
-		ratedPositions++;
+		_ctx.stats.ratedPositions++;
 
 		value = calcEvaluation();
 	    }
 	}
 	takeBack();
+	moveCount++;
 
 	/* For GUI response */
-	if (doDepthSearch && (maxDepth - depth >2))
-	    emit searchBreak();
+	if (doDepthSearch && (depthLeft >2) && _ctx.callback)
+	    _ctx.callback->searchBreak();
 
 #ifdef MYTRACE
 
 	if (doDepthSearch) {
-	    spyDepth = depth;
+	    _ctx.spyDepth = depth;
 
 	    if (spyLevel>1) {
 
-		indent(spyDepth);
-		if (oldSearchCalled < searchCalled) {
-		    qDebug("  %d Calls", searchCalled-oldSearchCalled);
-		    if (cutoffCount>oldCutoffCount)
-			qDebug(" (%d Cutoffs)", cutoffCount-oldCutoffCount);
+		indent(_ctx.spyDepth);
+		if (oldSearchCalled < _ctx.stats.searchCalled) {
+		    qDebug("  %d Calls", _ctx.stats.searchCalled-oldSearchCalled);
+		    if (_ctx.stats.cutoffCount>oldCutoffCount)
+			qDebug(" (%d Cutoffs)", _ctx.stats.cutoffCount-oldCutoffCount);
 		    qDebug(", GenMoves %d (%d/%d/%d played)",
-			   moveCount - oldMoveCount,
-			   normalCount - oldNormalCount,
-			   pushCount-oldPushCount,
-			   outCount-oldOutCount);
+			   _ctx.stats.moveCount - oldMoveCount,
+			   _ctx.stats.normalCount - oldNormalCount,
+			   _ctx.stats.pushCount-oldPushCount,
+			   _ctx.stats.outCount-oldOutCount);
 		    qDebug(", Rate# %d",
-			   ratedPositions+wonPositions
+			   _ctx.stats.ratedPositions+_ctx.stats.wonPositions
 			   - oldRatedPositions - oldWonPositions);
-		    if (wonPositions > oldWonPositions)
-			qDebug(" (%d Won)", wonPositions- oldWonPositions);
+		    if (_ctx.stats.wonPositions > oldWonPositions)
+			qDebug(" (%d Won)", _ctx.stats.wonPositions- oldWonPositions);
 		    qDebug("\n");
-		    indent(spyDepth);
+		    indent(_ctx.spyDepth);
 		}
 
 		qDebug("  => Rated %d%s\n",
@@ -1143,7 +1395,7 @@ int Board::search(int depth, int alpha, int beta)
 	}
 	else {
 	    if (spyLevel>2) {
-		indent(spyDepth);
+		indent(_ctx.spyDepth);
 		qDebug("%s (%6d .. %6d) %-25s => Rating %6d%s\n",
 		       (color==color1)?"O":"X", alpha,beta,
 		       m.name().toLatin1(),
@@ -1154,77 +1406,436 @@ int Board::search(int depth, int alpha, int beta)
 	    }
 	}
 
-	if (value>=beta) cutoffCount++;
+	if (value>=beta) _ctx.stats.cutoffCount++;
 #endif
 
-#ifdef SPION
-	if (bUpdateSpy) {
-	    if (value > actValue)
-		emit updateBest(depth, value, m, value >= beta);
-	    emit update(depth, value, m, true);
-	}
-#endif
 	if (value > actValue) {
 	    actValue = value;
-	    pv.update(depth, m);
+	    best = m;
+	    _ctx.pv.update(depth, m);
 
 	    // Only update best move if not stopping search
-	    if (!breakOut && (depth == 0)) {
-		_bestMove = m;
+	    if (!_ctx.breakOut && (depth == 0)) {
+		_ctx.bestMove = m;
 
-		if (bUpdateSpy) {
-		    emit updateBestMove(m, actValue);
+		if (_ctx.callback)
+		    _ctx.callback->bestMoveUpdated(m, actValue);
 #ifdef MYTRACE
-		    if (spyLevel>0) {
-			int i;
-			qDebug(">      New pv (Rating %d):", actValue);
-			for(i=0;i<=maxDepth;i++) {
-			    qDebug("\n>          D %d: %s",
-				   i, pv[i].name().toLatin1() );
-			}
-			qDebug("\n>\n");
+		if (spyLevel>0) {
+		    int i;
+		    qDebug(">      New pv (Rating %d):", actValue);
+		    for(i=0;i<=_ctx.maxDepth;i++) {
+			qDebug("\n>          D %d: %s",
+			       i, _ctx.pv[i].name().toLatin1() );
 		    }
-#endif
+		    qDebug("\n>\n");
 		}
+#endif
 	    }
 
-	    if (actValue>14900 || actValue >= beta)
-		return actValue;
+	    if (actValue>14900 || actValue >= beta) {
+		if (!_ctx.breakOut)
+		    _ctx.moveOrder.cutoff(m, depth, depthLeft);
+		break;
+	    }
 
 	    /* maximize alpha */
 	    if (actValue > alpha) alpha = actValue;
 	}
 
-	if (breakOut) depthPhase=false;
+	if (_ctx.breakOut) depthPhase=false;
 	m.type = Move::none;
     }
 
+    /* Values of an interrupted search are not reliable */
+    if (!_ctx.breakOut) {
+	value = actValue;
+	if (value > 14900) value += depth;
+	else if (value < -14900) value -= depth;
+
+	_transTable->store(_hashKey, depthLeft,
+			   (actValue >= beta)    ? TransEntry::lower :
+			   (actValue > oldAlpha) ? TransEntry::exact :
+						   TransEntry::upper,
+			   value, best);
+    }
+
     return actValue;
 }
 
+/* Search position after a move at <depth> with <depthLeft> plies */
+int Board::searchChild(int depth, int depthLeft, int alpha, int beta)
+{
+    if (depthLeft > 1)
+	return search(depth+1, alpha, beta);
+    return quiesce(depth+1, alpha, beta);
+}
 
-Move& Board::bestMove()
+/* Plies to reduce search depth for late quiet moves, by type.
+ * Broadside moves and moves of single stones rarely are best */
+static const int lateMoveReductions[Move::typeCount] = {
+    0, 0, 0, 0, 0, 0,  /* out and push moves */
+    1, 1, 1,           /* move3, left3, right3 */
+    1, 1, 1,           /* left2, right2, move2 */
+    2                  /* move1 */
+};
+
+int Board::lateMoveReduction(const Move& m, int depth, int depthLeft,
+			     int moveCount)
 {
-    int alpha=-15000,beta=15000;
-    int nalpha,nbeta, actValue;
+    if (_lmrMoves <= 0 || moveCount < _lmrMoves || depth == 0 ||
+	_ctx.inPrincipalVariation || depthLeft < 3 || m.isPushMove())
+	return 0;
+
+    /* killers already proved to be good at this ply */
+    for(int i = 0; i < MoveOrder::KillerSlots; i++) {
+	const Move& k = _ctx.moveOrder.killer(depth, i);
+	if (k.type == m.type && k.field == m.field &&
+	    k.direction == m.direction)
+	    return 0;
+    }
+
+    int r = lateMoveReductions[m.type];
+    /* one more for the tail of long move lists */
+    if (moveCount >= 4 * _lmrMoves) r++;
+    /* keep at least one ply of normal search */
+    if (r > depthLeft - 2) r = depthLeft - 2;
+    return r;
+}
+
+/* Null move: if passing still reaches <beta> with a search of reduced
+ * depth, a real move is assumed to do so, too */
+bool Board::nullMoveCutoff(int depth, int depthLeft, int beta,
+			   int moveCount, int& value)
+{
+    /* no two null moves in a row */
+    bool afterNull = _ctx.afterNull;
+    _ctx.afterNull = false;
+
+    if (_nullReduction <= 0 || afterNull || depth == 0 ||
+	_ctx.inPrincipalVariation || _ctx.breakOut ||
+	depthLeft < 2 ||
+	color1Count < NullMoveMinStones || color2Count < NullMoveMinStones ||
+	moveCount < NullMoveMinMoves || beta > 14900)
+	return false;
+
+    /* calcEvaluation rates for the color which moved last */
+    if (-calcEvaluation() < beta)
+	return false;
+
+    color = (color == color1) ? color2 : color1;
+    _hashKey ^= zobristColor;
+    _ctx.afterNull = true;
+    _ctx.reduction += _nullReduction;
+    if (depthLeft - _nullReduction > 1)
+	value = - search(depth+1, -beta, -beta+1);
+    else
+	value = - quiesce(depth+1, -beta, -beta+1);
+    _ctx.reduction -= _nullReduction;
+    _ctx.afterNull = false;
+    color = (color == color1) ? color2 : color1;
+    _hashKey ^= zobristColor;
+
+    if (value >= beta && _nullVerify && !_ctx.breakOut) {
+	/* same position, without null move at its root */
+	_ctx.afterNull = true;
+	_ctx.reduction += _nullReduction;
+	value = search(depth, beta-1, beta);
+	_ctx.reduction -= _nullReduction;
+	_ctx.afterNull = false;
+    }
+
+    if (value < beta || _ctx.breakOut)
+	return false;
+
+    /* do not return unproven wins */
+    if (value > 14900) value = beta;
+    return true;
+}
+
+/* Quiescence search: the side to move may keep the static evaluation
+ * ("stand pat") or try push and out moves */
+int Board::quiesce(int depth, int alpha, int beta)
+{
+    int actValue, value;
+    Move m;
+    MoveList list;
+
+    _ctx.stats.searchCalled++;
+    _ctx.nodes++;
+
+    if (limitReached() && (_ctx.bestMove.type != Move::none))
+	_ctx.breakOut = true;
+
+    /* calcEvaluation rates for the color which moved last */
+    _ctx.stats.ratedPositions++;
+    actValue = -calcEvaluation();
+    if (actValue >= beta || actValue > 14900 || actValue < -14900 ||
+	depth + _ctx.reduction >= _ctx.maxDepth + QuiescencePlies || _ctx.breakOut)
+	return actValue;
+    if (actValue > alpha) alpha = actValue;
+
+    /* value of the next stone pushed out; the 6th one wins */
+    int lost = 14 - ((color == color1) ? color2Count : color1Count);
+    int outGain = (lost < 5) ? _evalScheme->stoneValue(lost) -
+			       _evalScheme->stoneValue(lost+1) : 30000;
+
+    generateMoves(list);
+    list.setOrder(&_ctx.moveOrder, depth);
+
+    while(list.getNext(m, Move::maxPushType())) {
 
+	/* delta pruning */
+	if (actValue + DeltaMargin + (m.isOutMove() ? outGain : 0) <= alpha)
+	    continue;
+
+	playMove(m);
+	if (!isValid()) {
+	    value = 14999-depth;
+#ifdef MYTRACE
+	    _ctx.stats.wonPositions++;
+#endif
+	}
+	else
+	    value = - quiesce(depth+1,-beta,-alpha);
+	takeBack();
+
+	if (value > actValue) {
+	    actValue = value;
+	    if (actValue >= beta || actValue > 14900) break;
+	    if (actValue > alpha) alpha = actValue;
+	}
+	if (_ctx.breakOut) break;
+    }
+
+    return actValue;
+}
+
+
+/* Lazy SMP: helper threads search the same position, sharing the
+ * transposition table. Only the main search delivers the result */
+class SearchHelper : public QThread
+{
+public:
+    SearchHelper(Board& main, int id)
+    {
+	_id = id;
+	board.setupHelper(main);
+    }
+
+    /* table is owned by main board */
+    ~SearchHelper() { board._transTable = 0; }
+
+    Board board;
+
+protected:
+    /* every second helper starts one level deeper */
+    virtual void run() { board.iterate(1 + (_id % 2)); }
+
+private:
+    int _id;
+};
+
+void Board::setupHelper(Board& main)
+{
+    *this = main;
+    _transTable = main._transTable;
+    _ctx.depthLimit = main._ctx.depthLimit;
+    spyLevel = 0;
+    _isHelper = true;
+    _ctx.pv.clear(_ctx.depthLimit);
+    _ctx.moveOrder.clear();
+    _ctx.bestMove.type = Move::none;
+}
+
+void Board::startHelpers()
+{
+    /* thread scheduling would change the result */
+    int threads = _deterministic ? 1 : _threads;
+
+    for(int i=1;i<threads;i++) {
+	SearchHelper* h = new SearchHelper(*this, i);
+	_helpers.append(h);
+	h->start();
+    }
+}
+
+/* returns number of search calls done by helpers */
+int Board::stopHelpers()
+{
+    int calls = 0;
+
+    foreach(SearchHelper* h, _helpers)
+	h->board.stopSearch();
+
+    foreach(SearchHelper* h, _helpers) {
+	h->wait();
+	calls += h->board._ctx.stats.searchCalled;
+	delete h;
+    }
+    _helpers.clear();
+
+    return calls;
+}
+
+/* Set soft/hard limit for search time and node limit from <l>.
+ * After the soft limit, no new iteration is started; at the hard
+ * limit (or node limit), the running iteration is aborted */
+void Board::allocateTime(const SearchLimits& l)
+{
+    _ctx.softLimit = _ctx.hardLimit = 0;
+    _ctx.nodeLimit = 0;
+    /* limits are set with ponderHit() */
+    if (l.ponder) return;
+
+    _ctx.nodeLimit = l.nodes;
+    if (_deterministic) return;
+
+    if (l.moveTime > 0) {
+	_ctx.softLimit = _ctx.hardLimit = l.moveTime;
+	return;
+    }
+    if (l.timeLeft <= 0) return;
+
+    /* keep a reserve for overhead (e.g. network transfer) */
+    int avail = l.timeLeft - qMin(l.timeLeft/20, 500);
+    int movesToGo = (l.movesToGo > 0) ? l.movesToGo : 30;
+    int target = avail / movesToGo + l.increment;
+
+    _ctx.hardLimit = qMin(3 * target, avail);
+    if (target > _ctx.hardLimit) target = _ctx.hardLimit;
+    _ctx.softLimit = target / 2;
+
+    if (_ctx.hardLimit < 1) _ctx.hardLimit = 1;
+    if (_ctx.softLimit < 1) _ctx.softLimit = 1;
+}
+
+Move& Board::bestMove(const SearchLimits& l)
+{
     // if not yet set, use default scheme
     if (!_evalScheme) setEvalScheme();
 
-    pv.clear(realMaxDepth);
-    _bestMove.type = Move::none;
+    _ctx.nodes = 0;
+    if (bookMove())
+	return _ctx.bestMove;
 
-    maxDepth=1;
-    show = false;
-    breakOut = false;
-    spyDepth = 0;
+    if (!_transTable)
+	_transTable = new TransTable(_hashSize);
+
+    /* result only depends on position, settings and limits */
+    if (_deterministic) {
+	_transTable->clear();
+	_ctx.moveOrder.clear();
+    }
+
+    allocateTime(l);
+    _ctx.pondering = l.ponder;
+    _ctx.ponderTime = 0;
+    _ctx.timer.start();
+    if (l.depth > 0)
+	_ctx.depthLimit = l.depth + 1;
+    else if (_ctx.hardLimit > 0 || _ctx.nodeLimit > 0 || l.ponder)
+	_ctx.depthLimit = PrincipalVariation::maxDepth - 1;
+    else
+	_ctx.depthLimit = realMaxDepth;
+
+    _ctx.pv.clear(_ctx.depthLimit);
+    _ctx.completedPV.clear(_ctx.depthLimit);
+    _ctx.completedMove.type = Move::none;
+    _ctx.bestMove.type = Move::none;
+    _transTable->newSearch();
+    _ctx.moveOrder.newSearch();
+
+    _ctx.breakOut = false;
+    _ctx.spyDepth = 0;
 
     if (spyLevel>0)
 	qDebug("\n> New Search\n>");
 
+    startHelpers();
+    iterate(1);
+    int helperCalls = stopHelpers();
+
+    /* An aborted iteration may not have searched all moves */
+    if (_ctx.completedMove.type != Move::none) {
+	_ctx.bestMove = _ctx.completedMove;
+	_ctx.pv = _ctx.completedPV;
+    }
+
+    if (spyLevel>0 && _threads>1)
+	qDebug(">>> Search calls of %d helper threads: %d",
+	       _threads-1, helperCalls);
+    if (spyLevel>0 && _ctx.hardLimit>0)
+	qDebug(">>> Search time: %d ms (limits %d / %d)",
+	       (int) _ctx.timer.elapsed(), _ctx.softLimit, _ctx.hardLimit);
+
+    /* If Spy is On, we want replayable search: don't change rating! */
+    if (spyLevel==0 && !_deterministic)
+	changeEvaluation();
+    else if (spyLevel>0) {
+	qDebug(">>> Got Move : %s\n",qPrintable(_ctx.pv[0].name()));
+    }
+
+    _ctx.spyDepth = 0;
+
+    return _ctx.bestMove;
+}
+
+void Board::ponderHit(const SearchLimits& l)
+{
+    if (!_ctx.pondering) return;
+
+    SearchLimits hit = l;
+    hit.ponder = false;
+    allocateTime(hit);
+    if (_ctx.nodeLimit > 0)
+	_ctx.nodeLimit += _ctx.nodes;
+    if (l.depth > 0) {
+	_ctx.depthLimit = l.depth + 1;
+	_ctx.pv.setMaxDepth(_ctx.depthLimit);
+	_ctx.completedPV.setMaxDepth(_ctx.depthLimit);
+    }
+    _ctx.ponderTime = _ctx.timer.elapsed();
+    _ctx.pondering = false;
+}
+
+/* Set _bestMove from opening book, if position is found there */
+bool Board::bookMove()
+{
+    if (!_book) return false;
+
+    Move m = _book->choose(_hashKey, random());
+    if (m.type == Move::none) return false;
+
+    /* a position with same key could be another one */
+    MoveList list;
+    generateMoves(list);
+    if (!list.isElement(m, 0, false)) return false;
+
+    _ctx.pv.clear(realMaxDepth);
+    _ctx.pv.update(0, m);
+    _ctx.bestMove = m;
+    if (spyLevel>0)
+	qDebug(">>> Book move : %s\n", qPrintable(m.name()));
+    if (_ctx.callback)
+	_ctx.callback->bestMoveUpdated(m, 0);
+
+    return true;
+}
+
+/* Iterative deepening, starting with depth <startDepth> */
+void Board::iterate(int startDepth)
+{
+    int alpha=-15000,beta=15000;
+    int nalpha,nbeta, actValue;
+    int delta = AspirationWindow;
+    bool aborted;
+
+    _ctx.maxDepth=startDepth;
+
     do {
 	if (spyLevel>0)
-	    qDebug(">   MaxDepth: %d\n>", maxDepth);
+	    qDebug(">   MaxDepth: %d\n>", _ctx.maxDepth);
 
 	// ShowTiefe(maxtiefe);
 	do {
@@ -1232,19 +1843,12 @@ Move& Board::bestMove()
 		qDebug(">     AB-Window: (%d ... %d)\n>", alpha, beta);
 
 	    nalpha=alpha, nbeta=beta;
-	    inPrincipalVariation = (pv[0].type != Move::none);
-
-	    /* Statistics */
-	    searchCalled = 0;
-	    moveCount = 0;
-	    ratedPositions = 0;
-	    wonPositions = 0;
-	    normalCount = 0;
-	    pushCount = 0;
-	    outCount = 0;
-	    cutoffCount = 0;
+	    _ctx.inPrincipalVariation = (_ctx.pv[0].type != Move::none);
+
+	    _ctx.stats.clear();
 
 	    actValue = search(0,alpha,beta);
+	    aborted = _ctx.breakOut;
 
 	    if (spyLevel>0)
 	    {
@@ -1252,43 +1856,48 @@ Move& Board::bestMove()
 		if (spyLevel>1)
 		    qDebug(">");
 		qDebug(">      Got PV with Rating %d:",actValue);
-		for(i=0;i<=maxDepth;i++) {
-		    qDebug(">          D %d: %s", i, qPrintable(pv[i].name()));
+		for(i=0;i<=_ctx.maxDepth;i++) {
+		    qDebug(">          D %d: %s", i, qPrintable(_ctx.pv[i].name()));
 		}
 		qDebug(">");
 
 		qDebug(">      Search called    : %6d / %d Cutoffs",
-		       searchCalled, cutoffCount);
+		       _ctx.stats.searchCalled, _ctx.stats.cutoffCount);
 		qDebug(">       Moves generated : %6d / %d Played",
-		       moveCount, normalCount+pushCount+outCount);
+		       _ctx.stats.moveCount, _ctx.stats.normalCount+_ctx.stats.pushCount+_ctx.stats.outCount);
 		qDebug(">        Nrml/Push/Out  : %6d / %d / %d",
-		       normalCount,pushCount,outCount);
-		qDebug(">       Positions rated : %6d / %d Won\n>",
-		       ratedPositions+wonPositions, wonPositions);
+		       _ctx.stats.normalCount,_ctx.stats.pushCount,_ctx.stats.outCount);
+		qDebug(">       Positions rated : %6d / %d Won",
+		       _ctx.stats.ratedPositions+_ctx.stats.wonPositions, _ctx.stats.wonPositions);
+		qDebug(">        Hash hits      : %6d\n>", _ctx.stats.hashHits);
 
 	    }
 
 	    if (actValue > 14900 || actValue < -14900)
-		breakOut=true;
+		_ctx.breakOut=true;
 
 	    /* Don't break out if we haven't found a move */
-	    if (_bestMove.type == Move::none)
-		breakOut=false;
+	    if (_ctx.bestMove.type == Move::none && !_isHelper)
+		_ctx.breakOut=false;
+
+	    /* widen alpha-beta window on the failing side, in stages */
+	    delta *= 4;
+	    if (actValue <= nalpha)
+		alpha = qMax(actValue - delta, -15000);
+	    if (actValue >= nbeta)
+		beta = qMin(actValue + delta, 15000);
+	}
+	while(!_ctx.breakOut && (actValue<=nalpha || actValue>=nbeta));
 
-	    // widen alpha-beta window if needed
-	    if (actValue <= nalpha) {
-		alpha = -15000;
-		if (beta<15000) beta=actValue+1;
-	    }
-	    if (actValue >= nbeta) {
-		if (alpha > -15000) alpha = actValue-1;
-		beta=15000;
-	    }
+	if (!aborted && !_isHelper) {
+	    _ctx.completedMove = _ctx.bestMove;
+	    _ctx.completedPV = _ctx.pv;
 	}
-	while(!breakOut && (actValue<=nalpha || actValue>=nbeta));
 
 	/* Window in both directions cause of deepening */
-	alpha=actValue-200, beta=actValue+200;
+	delta = AspirationWindow;
+	alpha = qMax(actValue - delta, -15000);
+	beta = qMin(actValue + delta, 15000);
 	/*
 		  if ( (maxDepth+((color == color2)?1:0)) %2 ==1)
 		  alpha=actValue-200, beta=actValue+1;
@@ -1304,18 +1913,52 @@ Move& Board::bestMove()
 		  }
 		*/
     }
-    while(++maxDepth< realMaxDepth && !breakOut);
+    while(++_ctx.maxDepth< _ctx.depthLimit && !_ctx.breakOut &&
+	  !softTimeOut() &&
+	  (_ctx.nodeLimit==0 || _ctx.nodes < _ctx.nodeLimit));
+}
 
-    /* If Spy is On, we want replayable search: don't change rating! */
-    if (spyLevel==0)
-	changeEvaluation();
-    else {
-	qDebug(">>> Got Move : %s\n",qPrintable(pv[0].name()));
+quint64 Board::perft(int depth)
+{
+    MoveList list;
+    Move m;
+    quint64 count = 0;
+
+    if (depth == 0) return 1;
+
+    generateMoves(list);
+    while(list.getNext(m, Move::maxMoveType())) {
+	playMove(m);
+	if (isValid())
+	    count += perft(depth-1);
+	else
+	    count++;
+	takeBack();
     }
+    return count;
+}
 
-    spyDepth = 0;
+void Board::setDeterministic(bool on, quint64 seed)
+{
+    _deterministic = on;
+    _seed = seed;
+    if (!on) return;
 
-    return _bestMove;
+    /* undo rotations done after earlier searches */
+    setFieldValues();
+    if (_transTable)
+	_transTable->clear();
+}
+
+int Board::random()
+{
+    if (_deterministic) {
+	quint64 s = _seed ^ _hashKey;
+	return (int) (nextRandom(s) >> 33);
+    }
+
+    // FIXME: start with random seed using qsrand() somewhere
+    return qrand();
 }
 
 Move Board::randomMove()
@@ -1326,8 +1969,7 @@ Move Board::randomMove()
     generateMoves(list);
     int l = list.getLength();
 
-    // FIXME: start with random seed using qsrand() somewhere
-    int j = (qrand() % l) +1;
+    int j = (random() % l) +1;
 
     while(j != 0) {
 	list.getNext(m, Move::none);
@@ -1380,6 +2022,8 @@ bool Board::setState(const QString& state)
     int len = state.length();
     char c = ' ';
 
+    /* moves stored before belong to another position */
+    storedFirst = storedLast = 0;
     color1Count = 0;
     color2Count = 0;
 
@@ -1427,7 +2071,7 @@ bool Board::setState(const QString& state)
 	}
 
 	// not enough fields provided in this row?
-	if (c == '\n') return false;
+	if (c == '\n') break;
 
 	if (f == rowEnd) {
 	    row++;
@@ -1446,11 +2090,14 @@ bool Board::setState(const QString& state)
 		f = 8 + row*12;
 		rowEnd = 21 + row*11;
 	    }
-	    else
+	    else {
+		fieldsChanged();
 		return true;
+	    }
 	    // qDebug("Row %d: %d - %d, Idx %d\n", row, f, rowEnd, index);
 	}
     }
+    fieldsChanged();
     return false;
 }
 
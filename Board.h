@@ -27,11 +27,49 @@
 #ifndef _BOARD_H_
 #define _BOARD_H_
 
-#include <QObject>
+#include <QString>
+#include <QList>
+#include <QElapsedTimer>
+#include <QAtomicInt>
 #include "Move.h"
+#ifdef BITBOARD
+#include "BitBoard.h"
+#endif
 
 class KConfig;
 class EvalScheme;
+class TransTable;
+class OpeningBook;
+class SearchHelper;
+
+/* Statistics of a search (shown with spy level > 0) */
+class SearchStats
+{
+public:
+    SearchStats() { clear(); }
+    void clear();
+
+    int ratedPositions, wonPositions, searchCalled, moveCount;
+    int normalCount, pushCount, outCount, cutoffCount, hashHits;
+};
+
+/* Limits for a search, 0 meaning no limit.
+ * Without time limit, depth defaults to value given by Board::setDepth.
+ * When pondering, only depth is used until Board::ponderHit() */
+class SearchLimits
+{
+public:
+    SearchLimits()
+    { depth = moveTime = timeLeft = increment = movesToGo = nodes = 0;
+      ponder = false; }
+
+    int depth;
+    int moveTime;              /* time for this move (ms) */
+    int timeLeft, increment;   /* clock of color to move (ms) */
+    int movesToGo;             /* moves until next time control */
+    int nodes;                 /* search calls of main thread */
+    bool ponder;               /* search on opponent's time */
+};
 
 /* Class for best moves so far */
 class PrincipalVariation
@@ -50,6 +88,7 @@ public:
     { return (i<0 || i>=maxDepth) ? move[0][0] : move[0][i]; }
 
     void update(int d, Move& m);
+    void setLast(int d, const Move& m);
     void clear(int d);
     void setMaxDepth(int d)
     { actMaxDepth = (d>maxDepth) ? maxDepth-1 : d; }
@@ -61,13 +100,94 @@ private:
 };
 
 
-class Board : public QObject
+/* Flag set and read by different threads. No ordering with other
+ * data is implied: hand over further data with a mutex */
+class AtomicFlag
+{
+public:
+    AtomicFlag() {}
+
+    operator bool() const
+    {
+#if QT_VERSION >= 0x050000
+	return _v.load() != 0;
+#else
+	return _v != 0;
+#endif
+    }
+
+    AtomicFlag& operator=(bool b)
+    {
+#if QT_VERSION >= 0x050000
+	_v.store(b ? 1 : 0);
+#else
+	_v = b ? 1 : 0;
+#endif
+	return *this;
+    }
+
+private:
+    QAtomicInt _v;
+};
+
+
+/* Receives progress of a search, see Board::setCallback().
+ * Called in the searching thread: should return fast */
+class SearchCallback
+{
+public:
+    virtual ~SearchCallback() {}
+
+    /* called regularly while searching, e.g. to stop the search
+     * with Board::stopSearch() */
+    virtual void searchBreak() {}
+    /* new best move at root of search */
+    virtual void bestMoveUpdated(const Move&, int) {}
+};
+
+
+/* State of a search, separate from the position searched:
+ * principal variation, limits, statistics, move ordering and
+ * callback. Each search thread uses its own context */
+class SearchContext
 {
-    Q_OBJECT
+public:
+    SearchContext();
+
+    SearchStats stats;
+    PrincipalVariation pv;
+    PrincipalVariation completedPV;  /* of last finished iteration */
+    Move bestMove, completedMove;
+    AtomicFlag breakOut;             /* set from other threads */
+    bool inPrincipalVariation;
+    int maxDepth, depthLimit;
+    int reduction;    /* plies the current line is searched shallower */
+    bool afterNull;
+    int spyDepth;
+    MoveOrder moveOrder;             /* killers and history */
+
+    /* time limits in ms, see Board::allocateTime() */
+    QElapsedTimer timer;
+    int softLimit, hardLimit;
+    bool pondering;
+    int ponderTime;                  /* limits count from here */
+    qint64 nodes, nodeLimit;         /* search calls in this search */
+
+    SearchCallback* callback;
+};
 
+
+/* A position with the evaluation and search settings used for it.
+ * Copies get the position, evaluation and settings, but not the
+ * transposition table or the state of a search */
+class Board
+{
 public:
     Board();
-    ~Board() {}
+    Board(const Board&);
+    ~Board();
+
+    Board& operator=(const Board&);
 
     /* different states of one field */
     enum {
@@ -84,6 +204,9 @@ public:
     void begin(int startColor);  /* start of a game */
     void clear();                /* empty board     */
 
+    /* copy game state of <b> (fields, color, stored moves) */
+    void setPosition(const Board& b);
+
     /* fields can't be changed ! */
     int operator[](int no) const;
 
@@ -93,6 +216,9 @@ public:
     /* Generate list of allowed moves for player with <color>
    * Returns a calculated value for actual position */
     void generateMoves(MoveList& list);
+    /* Same as generateMoves, always walking the field array
+     * (used for checking the bitboard variant) */
+    void generateMovesByFields(MoveList& list);
 
     /* Functions handling moves
    * played moves can be taken back (<MvsStored> moves are remembered) */
@@ -117,10 +243,10 @@ public:
    * a little (so computer's moves aren't always the same) */
     void changeEvaluation();
 
-    void setActColor(int c) { color=c; }
+    void setActColor(int c);
     void setColor1Count(int c) { color1Count = c; }
     void setColor2Count(int c) { color2Count = c; }
-    void setField(int i, int v) { field[i] = v; }
+    void setField(int i, int v) { put(i, v); }
     void setMoveNo(int n) { moveNo = n; }
 
     void setSpyLevel(int);
@@ -136,45 +262,155 @@ public:
     /* Check that color1Count & color2Count is consisten with board */
     bool isConsistent();
 
+    /* Zobrist key of position (fields and color to move),
+     * incrementally updated by playMove/takeBack */
+    quint64 hashKey() const { return _hashKey; }
+
+    /* Memory in MB used for transposition table (0: no table) */
+    void setHashSize(int mb);
+
     /* Searching best move: alpha/beta search */
     void setDepth(int d)
     { realMaxDepth = d+1; }
-    Move& bestMove();
+    Move& bestMove(const SearchLimits&);
+    Move& bestMove() { return bestMove(SearchLimits()); }
+
+    /* search calls of last/running search (main thread only) */
+    qint64 nodes() const { return _ctx.nodes; }
+
+    /* Null-move pruning: the side to move passes, searched with the
+     * remaining depth reduced by <reduction> (0: off, default 2).
+     * With <verify>, a fail high is confirmed by a normal search
+     * reduced the same way */
+    void setNullMove(int reduction, bool verify = false)
+    { _nullReduction = reduction; _nullVerify = verify; }
+
+    /* Late move reductions: quiet moves after the first <moves> of a
+     * node (0: off, default 4) are searched with reduced depth, the
+     * plies depending on move type. Moves beating alpha are searched
+     * again with full depth */
+    void setLateMoveReduction(int moves) { _lmrMoves = moves; }
+
+    /* Opening book consulted by bestMove() before searching (0: none).
+     * The book is not owned, and may be shared by multiple boards */
+    void setBook(const OpeningBook* b) { _book = b; }
+
+    /* Deterministic mode, for comparing builds and reproducing
+     * searches: enabling it undoes rotations of the evaluation done
+     * by earlier searches. Each search starts with empty transposition
+     * table and move ordering, runs in one thread without time limits,
+     * and does not change the evaluation afterwards. Random choices (book moves,
+     * randomMove) only depend on <seed> and the position. Node limits
+     * (SearchLimits::nodes) are checked on every search call */
+    void setDeterministic(bool on, quint64 seed = 0);
+    bool isDeterministic() const { return _deterministic; }
+
+    /* Number of threads searching in parallel (default 1) */
+    void setThreads(int n) { _threads = (n<1) ? 1 : n; }
+    int threads() { return _threads; }
 
     /* next move in main combination */
-    Move& nextMove() { return pv[1]; }
+    Move& nextMove() { return _ctx.pv[1]; }
 
     Move randomMove();
-    void stopSearch() { breakOut = true; }
+    void stopSearch() { _ctx.breakOut = true; }
+    /* Opponent played the move a pondering search was started for:
+     * continue with limits <l>, counting from now. Only to be called
+     * in the searching thread, e.g. from SearchCallback::searchBreak() */
+    void ponderHit(const SearchLimits& l);
+
+    /* Number of positions reachable with <depth> moves, counting
+     * won positions reached earlier once (for checking move generation) */
+    quint64 perft(int depth);
 
     /* Readable representation */
     QString getState();
     bool setState(const QString&);
 
-    void updateSpy(bool b) { bUpdateSpy = b; }
+    /* progress of following searches is reported to <c> (0: none) */
+    void setCallback(SearchCallback* c) { _ctx.callback = c; }
 
     /* simple terminal view of position */
     void print();
 
     static int fieldDiffOfDir(int d) { return direction[d]; }
 
-signals:
-    void searchBreak();
-    void updateBestMove(Move&,int);
-
-    void update(int,int,Move&,bool);
-    void updateBest(int,int,Move&,bool);
-
 private:
     void setFieldValues();
 
+    /* change a field, keeping hash key, field value sums and
+     * stone masks up to date */
+    void put(int f, int v)
+    {
+	int old = field[f], i = ringIndex[f];
+
+	_hashKey ^= zobristKey(f, old) ^ zobristKey(f, v);
+	if (old == color1 || old == color2) {
+	    _fieldSum[old-1] -= fieldValue[i];
+	    _stones[old-1] &= ~(Q_UINT64_C(1) << i);
+	}
+	if (v == color1 || v == color2) {
+	    _fieldSum[v-1] += fieldValue[i];
+	    _stones[v-1] |= Q_UINT64_C(1) << i;
+	}
+	field[f] = v;
+#ifdef BITBOARD
+	_bits.set(f, v);
+#endif
+    }
+    static quint64 zobristKey(int f, int v)
+    { return (v == color1 || v == color2) ? zobrist[v-1][f] : 0; }
+    quint64 calcHashKey();
+    /* recalculate state derived from fields (hash key, bitboard,
+     * field value sums) */
+    void fieldsChanged();
+    void calcFieldSums();
+
     /* helper function for generateMoves */
     void generateFieldMoves(int, MoveList&);
     /* helper function for calcValue */
     void countFrom(int,int, MoveTypeCounter&, InARowCounter&);
     /* helper functions for bestMove (recursive search!) */
+    /* Searches after the first are started with a window of
+     * +-AspirationWindow around the value of the previous iteration.
+     * On failing, the window is widened by a factor of 4 */
+    enum { AspirationWindow = 200 };
+    void iterate(int startDepth);
+    void allocateTime(const SearchLimits&);
+    bool hardTimeOut()
+    { return _ctx.hardLimit>0 &&
+	     _ctx.timer.elapsed() >= _ctx.ponderTime + _ctx.hardLimit; }
+    bool softTimeOut()
+    { return _ctx.softLimit>0 &&
+	     _ctx.timer.elapsed() >= _ctx.ponderTime + _ctx.softLimit; }
+    /* time is looked at only every 64 search calls */
+    bool limitReached()
+    { return (_ctx.nodeLimit>0 && _ctx.nodes >= _ctx.nodeLimit) ||
+	     ((_ctx.nodes & 63) == 0 && hardTimeOut()); }
+    /* random number >= 0, see setDeterministic() */
+    int random();
     int search(int, int, int);
+    int searchChild(int depth, int depthLeft, int alpha, int beta);
     int search2(int, int, int);
+    /* only push and out moves, for at most QuiescencePlies beyond
+     * maxDepth. Push moves not reaching alpha by DeltaMargin are
+     * pruned (out moves with value of the stone) */
+    enum { QuiescencePlies = 6, DeltaMargin = 200 };
+    int quiesce(int, int, int);
+    /* No null move with a side near to losing (stones left), or
+     * with few moves: passing could be better than any move */
+    enum { NullMoveMinStones = 11, NullMoveMinMoves = 10 };
+    bool nullMoveCutoff(int depth, int depthLeft, int beta,
+			int moveCount, int& value);
+    int lateMoveReduction(const Move& m, int depth, int depthLeft,
+			  int moveCount);
+    bool bookMove();
+
+    /* parallel search */
+    friend class SearchHelper;
+    void setupHelper(Board& main);
+    void startHelpers();
+    int stopHelpers();
 
     int field[AllFields];         /* actual board */
     int color1Count, color2Count;
@@ -184,22 +420,47 @@ private:
     int storedFirst, storedLast;  /* stored in ring puffer manner */
 
     /* for search */
-    PrincipalVariation pv;
-    Move _bestMove;
-    bool breakOut, inPrincipalVariation, show, bUpdateSpy;
-    int maxDepth, realMaxDepth;
-
-    int spyLevel, spyDepth;
+    SearchContext _ctx;
+    int realMaxDepth;
+    int spyLevel;
     EvalScheme* _evalScheme;
+    TransTable* _transTable;     /* allocated on first search */
+    const OpeningBook* _book;
+    int _hashSize;
+    int _threads;
+    int _nullReduction;
+    bool _nullVerify;
+    int _lmrMoves;
+    bool _deterministic;
+    quint64 _seed;              /* see random() */
+    bool _isHelper;
+    QList<SearchHelper*> _helpers;
+    quint64 _hashKey;
+#ifdef BITBOARD
+    BitBoard _bits;
+#endif
+
 
-    /* ratings; semi constant - are rotated by changeRating() */
-    static int fieldValue[RealFields];
+    /* ratings; semi constant - are rotated by changeEvaluation().
+     * Per board: boards searching in other threads are not affected */
+    int fieldValue[RealFields];
+
+    /* updated by put(), per color: sum of fieldValue of own stones,
+     * and stones as bit mask with bit i for field order[i] */
+    int _fieldSum[2];
+    quint64 _stones[2];
 
     /* constant arrays */
     static int startBoard[AllFields];
     static int order[RealFields];
+    static int ringIndex[AllFields];  /* inverse of order, -1 if out */
+    static bool initRingIndex(), ringIndexDone;
     static int direction[8];
 
+    /* random keys for hashing, see calcHashKey() */
+    static quint64 zobrist[2][AllFields], zobristColor;
+    static quint64 initZobrist();
+
     //  static int stoneValue[6];
     //  static int moveValue[Move::typeCount];
     //  static int connectValue[ConnectCounter::connectCount];
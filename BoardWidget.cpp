@@ -26,6 +26,7 @@
 
 #include <QBitmap>
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QPainter>
 #include <QPolygon>
 #include <QCursor>
@@ -259,7 +260,7 @@ void BoardWidget::drawBoard()
 }
 
 
-void BoardWidget::paintEvent(QPaintEvent *)
+void BoardWidget::paintEvent(QPaintEvent *e)
 {
     QPainter p(this);
 
@@ -269,7 +270,7 @@ void BoardWidget::paintEvent(QPaintEvent *)
     /* draw balls */
 
     if (renderMode) {
-	drawPieces(&p);
+	drawPieces(&p, e->region());
 	return;
     }
 
@@ -1027,8 +1028,10 @@ QSize  BoardWidget::sizeHint() const
 TestGame::TestGame(Network* n) : w(b), _n(n)
 {
     connect(&w, SIGNAL(moveChoosen(Move&)), SLOT(draw(Move&)));
+    n->setBoard(&b);
     connect(n, SIGNAL(gotPosition(const char*)),
 	    SLOT(newPosition(const char*)));
+    connect(n, SIGNAL(gotMove(Move)), SLOT(newMove(Move)));
     w.renderPieces(true);
     w.show();
 }
@@ -1054,7 +1057,7 @@ void TestGame::draw(Move& m)
 {
     if (m.isValid()) {
 	b.playMove(m);
-	if (_n) _n->broadcast(&b);
+	if (_n) _n->broadcastMove(m);
     }
     initInput();
 }
@@ -1067,6 +1070,13 @@ void TestGame::newPosition(const char* p)
     initInput();
 }
 
+void TestGame::newMove(Move m)
+{
+    b.playMove(m);
+    qDebug("Got move %s from network...", qPrintable(m.name()));
+    initInput();
+}
+
 #ifdef BOARDWIDGET_TEST
 
 #include <QApplication>
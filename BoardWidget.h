@@ -145,6 +145,7 @@ public slots:
     void startOnEmpty();
     void draw(Move& m);
     void newPosition(const char*);
+    void newMove(Move m);
 };
 
 
@@ -0,0 +1,390 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Engine without GUI, see Engine.h for the protocol */
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include <stdio.h>
+
+#include "Engine.h"
+
+void StdinReader::run()
+{
+    QTextStream in(stdin);
+
+    while(1) {
+	QString line = in.readLine();
+	if (line.isNull()) break;
+	emit lineRead(line);
+	if (line.trimmed() == "quit") return;
+    }
+    emit closed();
+}
+
+
+Engine::Engine(QObject* parent)
+    : QObject(parent)
+{
+    _readingState = false;
+    _quitAfterSearch = false;
+
+    _board.begin(Board::color1);
+    _search.setSpyLevel(0);
+
+    connect(&_search, SIGNAL(progress(Move,int)),
+	    this, SLOT(progress(Move,int)));
+    connect(&_search, SIGNAL(moveFound(Move)),
+	    this, SLOT(moveFound(Move)));
+}
+
+Engine::~Engine()
+{
+    _search.cancelSearch();
+    _reader.wait();
+}
+
+void Engine::start()
+{
+    connect(&_reader, SIGNAL(lineRead(QString)),
+	    this, SLOT(command(QString)));
+    connect(&_reader, SIGNAL(closed()),
+	    this, SLOT(inputClosed()));
+    _reader.start();
+}
+
+void Engine::reply(const QString& s)
+{
+    fputs(s.toLatin1().constData(), stdout);
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+void Engine::command(QString line)
+{
+    if (_readingState) {
+	if (line.trimmed() != "end") {
+	    _state += line + '\n';
+	    return;
+	}
+	_readingState = false;
+
+	/* keep current position if parsing fails */
+	Board b;
+	if (b.setState(_state))
+	    _board.setPosition(b);
+	else
+	    reply("error invalid position");
+	return;
+    }
+
+    QStringList args = line.split(' ', QString::SkipEmptyParts);
+    if (args.isEmpty()) return;
+    QString cmd = args.takeFirst();
+
+    if (cmd == "isready") {
+	reply("readyok");
+	return;
+    }
+    if (cmd == "quit") {
+	_search.cancelSearch();
+	QCoreApplication::quit();
+	return;
+    }
+    if (cmd == "stop") {
+	if (_search.isPondering())
+	    _search.cancelSearch();
+	else
+	    _search.stopSearch();
+	return;
+    }
+    if (cmd == "ponderhit") {
+	ponderHit(args);
+	return;
+    }
+    if (_search.isSearching()) {
+	reply("error searching");
+	return;
+    }
+
+    if (cmd == "new")
+	_board.begin(Board::color1);
+    else if (cmd == "position") {
+	_readingState = true;
+	_state.clear();
+    }
+    else if (cmd == "state") {
+	QString s = _board.getState();
+	if (s.startsWith('\n')) s.remove(0, 1);
+	reply(s + "end");
+    }
+    else if (cmd == "moves") {
+	MoveList list;
+	Move m;
+	QString s("moves");
+
+	_board.generateMoves(list);
+	while(list.getNext(m, Move::none))
+	    s += ' ' + m.name();
+	reply(s);
+    }
+    else if (cmd == "play")
+	play(args);
+    else if (cmd == "undo") {
+	if (!_board.takeBack())
+	    reply("error no move to take back");
+    }
+    else if (cmd == "go")
+	go(args);
+    else if (cmd == "ponder")
+	ponder(args);
+    else if (cmd == "perft")
+	perft(args);
+    else if (cmd == "threads" && args.size() == 1)
+	_search.setThreads(args[0].toInt());
+    else if (cmd == "hash" && args.size() == 1)
+	_search.setHashSize(args[0].toInt());
+    else if (cmd == "nullmove" && args.size() >= 1)
+	_search.setNullMove(args[0].toInt(),
+			    args.size() > 1 && args[1] == "verify");
+    else if (cmd == "lmr" && args.size() == 1)
+	_search.setLateMoveReduction(args[0].toInt());
+    else if (cmd == "book" && args.size() == 1) {
+	_search.setBook(0);
+	if (args[0] == "off")
+	    _book.close();
+	else if (_book.open(args[0]))
+	    _search.setBook(&_book);
+	else
+	    reply("error cannot open book " + args[0]);
+    }
+    else if (cmd == "deterministic" && args.size() == 1)
+	_search.setDeterministic(args[0] != "off",
+				 args[0].toULongLong());
+    else
+	reply("error unknown command " + line.trimmed());
+}
+
+void Engine::inputClosed()
+{
+    /* deliver result of a running search before quitting */
+    if (_search.isSearching())
+	_quitAfterSearch = true;
+    else
+	QCoreApplication::quit();
+}
+
+/* search move with name <name> in allowed moves */
+bool Engine::findMove(const QString& name, Move& m)
+{
+    MoveList list;
+
+    _board.generateMoves(list);
+    while(list.getNext(m, Move::none))
+	if (m.name().compare(name, Qt::CaseInsensitive) == 0)
+	    return true;
+
+    return false;
+}
+
+void Engine::play(const QStringList& args)
+{
+    Move m;
+
+    foreach(const QString& name, args) {
+	if (!_board.isValid()) {
+	    reply("error game is over");
+	    return;
+	}
+	if (!findMove(name, m)) {
+	    reply("error illegal move " + name);
+	    return;
+	}
+	_board.playMove(m);
+    }
+}
+
+/* Counts positions below some root moves on an own board */
+class PerftThread : public QThread
+{
+public:
+    Board board;
+    QList<int> moveIndex;   /* root moves of this thread */
+    const Move* moves;
+    quint64* counts;
+    int depth;
+
+    virtual void run()
+    {
+	foreach(int i, moveIndex) {
+	    board.playMove(moves[i]);
+	    counts[i] = board.isValid() ? board.perft(depth-1) : 1;
+	    board.takeBack();
+	}
+    }
+};
+
+void Engine::perft(const QStringList& args)
+{
+    int depth = 0, threads = 1, count = 0, i;
+    bool ok = (args.size() == 1 || args.size() == 3);
+    Move moves[MoveList::MaxMoves], m;
+    quint64 counts[MoveList::MaxMoves], nodes = 0;
+    MoveList list;
+
+    if (ok) depth = args[0].toInt(&ok);
+    if (ok && args.size() == 3) {
+	ok = (args[1] == "threads");
+	threads = args[2].toInt();
+    }
+    if (!ok || depth < 1 || threads < 1) {
+	reply("error usage: perft <depth> [threads <n>]");
+	return;
+    }
+
+    _timer.start();
+    _board.generateMoves(list);
+    while(list.getNext(m, Move::maxMoveType()))
+	moves[count++] = m;
+
+    QList<PerftThread*> workers;
+    for(i=0;i<threads;i++) {
+	PerftThread* t = new PerftThread;
+	t->board.setPosition(_board);
+	t->moves = moves;
+	t->counts = counts;
+	t->depth = depth;
+	workers.append(t);
+    }
+    for(i=0;i<count;i++)
+	workers[i % threads]->moveIndex.append(i);
+
+    /* the first part is done in this thread */
+    for(i=1;i<threads;i++)
+	workers[i]->start();
+    workers[0]->run();
+    for(i=1;i<threads;i++)
+	workers[i]->wait();
+    qDeleteAll(workers);
+
+    for(i=0;i<count;i++) {
+	reply(QString("divide %1 %2").arg(moves[i].name()).arg(counts[i]));
+	nodes += counts[i];
+    }
+    qint64 ms = _timer.elapsed();
+    reply(QString("perft depth %1 nodes %2 time %3 nps %4")
+	  .arg(depth).arg(nodes).arg(ms)
+	  .arg((quint64) (ms > 0 ? nodes * 1000 / ms : nodes * 1000)));
+}
+
+/* Limits as given to go, with default depth if none is given */
+bool Engine::parseLimits(const QStringList& args, SearchLimits& l)
+{
+    int i;
+
+    if (args.size() % 2 != 0) {
+	reply("error missing value for limit");
+	return false;
+    }
+    for(i=0;i<args.size();i+=2) {
+	bool ok;
+	int v = args[i+1].toInt(&ok);
+
+	if (!ok || v < 0) {
+	    reply("error invalid value " + args[i+1]);
+	    return false;
+	}
+	if (args[i] == "depth") l.depth = v;
+	else if (args[i] == "nodes") l.nodes = v;
+	else if (args[i] == "movetime") l.moveTime = v;
+	else if (args[i] == "time") l.timeLeft = v;
+	else if (args[i] == "inc") l.increment = v;
+	else if (args[i] == "movestogo") l.movesToGo = v;
+	else {
+	    reply("error unknown limit " + args[i]);
+	    return false;
+	}
+    }
+    if (l.depth == 0 && l.nodes == 0 && l.moveTime == 0 && l.timeLeft == 0)
+	l.depth = DefaultDepth;
+    return true;
+}
+
+void Engine::go(const QStringList& args)
+{
+    SearchLimits l;
+
+    if (!parseLimits(args, l)) return;
+
+    if (!_board.isValid()) {
+	reply("bestmove none");
+	return;
+    }
+
+    _timer.start();
+    _search.startSearch(_board, l);
+}
+
+void Engine::ponder(const QStringList& args)
+{
+    SearchLimits l;
+
+    if (!parseLimits(args, l)) return;
+
+    if (!_board.isValid() || !_search.startPonder(_board, l)) {
+	reply("error no move to ponder");
+	return;
+    }
+    _ponderLimits = l;
+    reply("ponder " + _search.ponderMove().name());
+}
+
+void Engine::ponderHit(const QStringList& args)
+{
+    SearchLimits l = _ponderLimits;
+
+    if (!_search.isPondering()) {
+	reply("error not pondering");
+	return;
+    }
+    if (!args.isEmpty()) {
+	l = SearchLimits();
+	if (!parseLimits(args, l)) return;
+    }
+
+    Move m = _search.ponderMove();
+    _board.playMove(m);
+    _timer.start();
+    _search.ponderHit(_board, l);
+}
+
+void Engine::progress(Move m, int value)
+{
+    reply(QString("info move %1 value %2 time %3")
+	  .arg(m.name()).arg(value).arg(_timer.elapsed()));
+}
+
+void Engine::moveFound(Move m)
+{
+    reply(QString("info nodes %1 time %2")
+	  .arg(_search.nodes()).arg(_timer.elapsed()));
+    reply("bestmove " + (m.isValid() ? m.name() : QString("none")));
+
+    if (_quitAfterSearch)
+	QCoreApplication::quit();
+}
@@ -0,0 +1,131 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Engine without GUI, driven by a line based protocol on stdin/stdout
+ *
+ * Commands (one per line, replies in brackets):
+ *   new                  start position, O to move
+ *   position             followed by a position in the format of
+ *                        Board::getState(), ended by a line "end"
+ *   state                print position [lines of getState(), "end"]
+ *   moves                [moves <move>...] allowed moves
+ *   play <move>...       play moves, named as by Move::name()
+ *   undo                 take back last move
+ *   go [depth <n>] [nodes <n>] [movetime <ms>]
+ *      [time <ms>] [inc <ms>] [movestogo <n>]
+ *                        start search; without limits, depth 3
+ *                        [info move <move> value <v> time <ms>]*
+ *                        [info nodes <n> time <ms>]
+ *                        [bestmove <move>|none]
+ *   stop                 stop search, reporting best move found;
+ *                        ends pondering without reply
+ *   ponder [<limits>]    after playing own best move: search the reply
+ *                        predicted by last search while opponent thinks,
+ *                        limits as for go [ponder <move>]
+ *   ponderhit [<limits>] predicted move was played: it is played on the
+ *                        board, and the search goes on with <limits>
+ *                        (default: as given to ponder), counting from
+ *                        now. Replies as for go
+ *   perft <depth> [threads <n>]
+ *                        count positions reachable with <depth> moves,
+ *                        root moves split among <n> threads
+ *                        [divide <move> <count>]*
+ *                        [perft depth <d> nodes <n> time <ms> nps <n>]
+ *   threads <n>, hash <mb>
+ *   nullmove <r> [verify]
+ *                        null-move reduction, 0 to disable; "verify"
+ *                        re-searches fail-highs with reduced depth
+ *   lmr <n>              reduce quiet moves after the first <n>,
+ *                        0 to disable
+ *   book <file>|off      play moves from opening book, if found there
+ *   deterministic <seed>|off
+ *                        reproducible searches: same node counts and
+ *                        moves for same position, settings and limits
+ *   isready              [readyok], after all previous commands
+ *   quit
+ * Errors are reported as "error <text>".
+ */
+
+#ifndef _ENGINE_H_
+#define _ENGINE_H_
+
+#include <QThread>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include "Board.h"
+#include "SearchThread.h"
+#include "OpeningBook.h"
+
+/* Reads lines from stdin, without blocking the event loop.
+ * Stops at end of input or after a line "quit" */
+class StdinReader : public QThread
+{
+    Q_OBJECT
+
+signals:
+    void lineRead(QString);
+    void closed();
+
+protected:
+    virtual void run();
+};
+
+class Engine : public QObject
+{
+    Q_OBJECT
+
+public:
+    Engine(QObject* parent = 0);
+    ~Engine();
+
+    enum { DefaultDepth = 3 };
+
+    /* start reading commands */
+    void start();
+
+private slots:
+    void command(QString);
+    void inputClosed();
+    void progress(Move m, int value);
+    void moveFound(Move m);
+
+private:
+    void reply(const QString&);
+    bool parseLimits(const QStringList&, SearchLimits&);
+    void go(const QStringList&);
+    void ponder(const QStringList&);
+    void ponderHit(const QStringList&);
+    void play(const QStringList&);
+    void perft(const QStringList&);
+    bool findMove(const QString&, Move&);
+
+    Board _board;
+    SearchThread _search;
+    OpeningBook _book;
+    StdinReader _reader;
+    QElapsedTimer _timer;
+    SearchLimits _ponderLimits;
+
+    bool _readingState;     /* lines are part of a position */
+    QString _state;
+    bool _quitAfterSearch;
+};
+
+#endif /* _ENGINE_H_ */
@@ -23,12 +23,12 @@
 #include <QStringList>
 
 // Default Values
-static int defaultRingValue[] = { 45, 35, 25, 10, 0 };
-static int defaultRingDiff[]  = {  0, 10, 10,  8, 5 };
-static int defaultStoneValue[]= { 0,-800,-1800,-3000,-4400,-6000 };
-static int defaultMoveValue[Move::typeCount] = { 40,30,30, 15,14,13,
-						 5,5,5, 2,2,2, 1 };
-static int defaultInARowValue[InARowCounter::inARowCount]= { 2, 5, 4, 3 };
+static const int defaultRingValue[] = { 45, 35, 25, 10, 0 };
+static const int defaultRingDiff[]  = {  0, 10, 10,  8, 5 };
+static const int defaultStoneValue[]= { 0,-800,-1800,-3000,-4400,-6000 };
+static const int defaultMoveValue[Move::typeCount] = { 40,30,30, 15,14,13,
+						       5,5,5, 2,2,2, 1 };
+static const int defaultInARowValue[InARowCounter::inARowCount]= { 2, 5, 4, 3 };
 
 
 /**
@@ -19,14 +19,15 @@
 #include "MainWindow.h"
 #include "BoardWidget.h"
 #include "Network.h"
+#include "SearchThread.h"
 
 #include <QStatusBar>
 #include <QAction>
 #include <QMenuBar>
 #include <QMenu>
 #include <QToolBar>
-#include <QTimer>
 #include <QMessageBox>
+#include <QCoreApplication>
 
 MainWindow::MainWindow(Network *n)
 {
@@ -45,6 +46,7 @@ MainWindow::MainWindow(Network *n)
     _statusbar->addWidget(_statusLabel, 1);
 
     _computerDepth = 3;
+    _computerTime = 0;
     _network = n;
     _board = new Board();
     _board->setDepth(_computerDepth);
@@ -52,16 +54,38 @@ MainWindow::MainWindow(Network *n)
     _boardWidget->renderPieces(true);
     setCentralWidget(_boardWidget);
 
+    /* computer player searches in background */
+    _searchThread = new SearchThread(this);
+    connect(_searchThread, SIGNAL(moveFound(Move)),
+	    SLOT(moveFound(Move)));
+    connect(_searchThread, SIGNAL(progress(Move,int)),
+	    SLOT(searchProgress(Move,int)));
+
+    /* optional opening book, installed next to the binary */
+    if (_book.open(QCoreApplication::applicationDirPath() +
+		   "/qenolaba.book"))
+	_searchThread->setBook(&_book);
+
     connect(_boardWidget, SIGNAL(moveChoosen(Move&)),
 	    SLOT(draw(Move&)));
-    if (n)
+    if (n) {
+	n->setBoard(_board);
 	connect(n, SIGNAL(gotPosition(const char*)),
 		SLOT(newPosition(const char*)));
+	connect(n, SIGNAL(gotMove(Move)),
+		SLOT(newMove(Move)));
+    }
 
     setWindowIcon(QIcon(":/app.png"));
     updateStatus();
 }
 
+MainWindow::~MainWindow()
+{
+    /* the search may use _book, which is destroyed before children */
+    _searchThread->cancelSearch();
+}
+
 void MainWindow::createActions()
 {
     // file menu actions
@@ -100,12 +124,18 @@ void MainWindow::createActions()
     _d3Action->setCheckable(true);
     _d4Action = new QAction(tr("Level &4: Challange"), this);
     _d4Action->setCheckable(true);
+    _t1Action = new QAction(tr("&Timed: 1 second per move"), this);
+    _t1Action->setCheckable(true);
+    _t5Action = new QAction(tr("T&imed: 5 seconds per move"), this);
+    _t5Action->setCheckable(true);
 
     _depthGroup = new QActionGroup(this);
     _depthGroup->addAction(_d1Action);
     _depthGroup->addAction(_d2Action);
     _depthGroup->addAction(_d3Action);
     _depthGroup->addAction(_d4Action);
+    _depthGroup->addAction(_t1Action);
+    _depthGroup->addAction(_t5Action);
     QAction* a = _d2Action;
     switch(_computerDepth) {
     case 2: a = _d1Action; break;
@@ -116,6 +146,15 @@ void MainWindow::createActions()
     connect(_depthGroup, SIGNAL(triggered(QAction*)),
 	    SLOT(depthSet(QAction*)));
 
+    _threadsAction = new QAction(tr("Use all CPU &cores"), this);
+    _threadsAction->setCheckable(true);
+    _threadsAction->setStatusTip(tr("Computer searches with multiple threads"));
+    connect(_threadsAction, SIGNAL(toggled(bool)), SLOT(threadsSet(bool)));
+
+    _ponderAction = new QAction(tr("Think on &opponent's time"), this);
+    _ponderAction->setCheckable(true);
+    _ponderAction->setStatusTip(tr("Computer searches expected reply while waiting"));
+
     // help menu actions
     _aboutAction = new QAction(tr("&About Qenolaba..."), this);
     _aboutAction->setStatusTip(tr("Show the application's About box"));
@@ -141,6 +180,11 @@ void MainWindow::createMenu()
     optionMenu->addAction(_d2Action);
     optionMenu->addAction(_d3Action);
     optionMenu->addAction(_d4Action);
+    optionMenu->addAction(_t1Action);
+    optionMenu->addAction(_t5Action);
+    optionMenu->addSeparator();
+    optionMenu->addAction(_threadsAction);
+    optionMenu->addAction(_ponderAction);
 
     QMenu* helpMenu = mBar->addMenu(tr("&Help"));
     helpMenu->addAction(_aboutAction);
@@ -162,17 +206,31 @@ void MainWindow::initInput()
     qDebug("%s", qPrintable(_board->getState()));
 
     if (!updateStatus()) {
+	_searchThread->cancelSearch();
 	_boardWidget->updatePosition(true);
 	return;
     }
 
-    if (((_board->actColor() == Board::color1) && _redAction->isChecked()) ||
-	((_board->actColor() == Board::color2) && _yellowAction->isChecked())) {
-
-	_moveToDraw = _board->bestMove();
-	QTimer::singleShot(50, this, SLOT(draw()));
+    SearchLimits l;
+    if (_computerTime > 0)
+	l.moveTime = _computerTime;
+    else
+	l.depth = _computerDepth;
+
+    if (computerPlays(_board->actColor())) {
+	/* result is delivered to moveFound(). If the move was
+	 * expected, the search started while waiting continues */
+	if (!_searchThread->ponderHit(*_board, l))
+	    _searchThread->startSearch(*_board, l);
     }
     else {
+	/* search expected reply while user or network peer is choosing */
+	int other = (_board->actColor() == Board::color1) ?
+			Board::color2 : Board::color1;
+	if (!_ponderAction->isChecked() || !computerPlays(other) ||
+	    !_searchThread->startPonder(*_board, l))
+	    _searchThread->cancelSearch();
+
 	_board->generateMoves(_moveList);
 	_boardWidget->choseMove(&_moveList);
     }
@@ -198,8 +256,15 @@ bool MainWindow::updateStatus()
     return false;
 }
 
+bool MainWindow::computerPlays(int color)
+{
+    return ((color == Board::color1) && _redAction->isChecked()) ||
+	   ((color == Board::color2) && _yellowAction->isChecked());
+}
+
 void MainWindow::newGame()
 {
+    _searchThread->cancelSearch();
     _board->begin(_startAction->isChecked() ? Board::color1 : Board::color2);
     if (_network) _network->broadcast(_board);
     initInput();
@@ -228,14 +293,22 @@ void MainWindow::depthSet(QAction* a)
     if (a == _d2Action) _computerDepth = 3;
     if (a == _d3Action) _computerDepth = 4;
     if (a == _d4Action) _computerDepth = 5;
+    _computerTime = 0;
+    if (a == _t1Action) _computerTime = 1000;
+    if (a == _t5Action) _computerTime = 5000;
     _board->setDepth(_computerDepth);
 }
 
+void MainWindow::threadsSet(bool all)
+{
+    _searchThread->setThreads(all ? QThread::idealThreadCount() : 1);
+}
+
 void MainWindow::draw(Move& m)
 {
     if (m.isValid()) {
 	_board->playMove(m);
-	if (_network) _network->broadcast(_board);
+	if (_network) _network->broadcastMove(m);
     }
     initInput();
 }
@@ -244,12 +317,13 @@ void MainWindow::draw()
 {
     if (_moveToDraw.isValid()) {
 	_board->playMove(_moveToDraw);
-	if (_network) _network->broadcast(_board);
+	if (_network) _network->broadcastMove(_moveToDraw);
     }
     initInput();
 }
 
 
+/* A search running (e.g. pondering) is handled in initInput() */
 void MainWindow::newPosition(const char* p)
 {
     QString s(p);
@@ -258,3 +332,24 @@ void MainWindow::newPosition(const char* p)
     initInput();
 }
 
+void MainWindow::newMove(Move m)
+{
+    _board->playMove(m);
+    qDebug("Got move %s from network...", qPrintable(m.name()));
+    initInput();
+}
+
+
+void MainWindow::moveFound(Move m)
+{
+    _moveToDraw = m;
+    draw();
+}
+
+void MainWindow::searchProgress(Move m, int value)
+{
+    if (!updateStatus()) return;
+
+    _statusLabel->setText(_statusLabel->text() +
+			  tr(" (thinking: %1, %2)").arg(m.name()).arg(value));
+}
@@ -24,11 +24,13 @@
 #include <QActionGroup>
 
 #include "Move.h"
+#include "OpeningBook.h"
 
 class Board;
 class BoardWidget;
 class MoveList;
 class Network;
+class SearchThread;
 
 class MainWindow : public QMainWindow
 {
@@ -37,6 +39,7 @@ class MainWindow : public QMainWindow
 
 public:
   MainWindow(Network* n = 0);
+  ~MainWindow();
 
   void createActions();
   void createMenu();
@@ -46,20 +49,28 @@ public slots:
   void newGame();
   void about();
   void depthSet(QAction*);
+  void threadsSet(bool);
   void draw(Move& m);
   void draw();
   void newPosition(const char*);
+  void newMove(Move m);
+  void moveFound(Move m);
+  void searchProgress(Move m, int value);
 
 private:
   void initInput();
   bool updateStatus();
+  bool computerPlays(int color);
 
   int _computerDepth;
+  int _computerTime; /* ms per move, 0: search to _computerDepth */
   Move _moveToDraw;
 
   QAction *_newAction, *_quitAction, *_startAction;
   QAction *_redAction, *_yellowAction;
   QAction *_d1Action, *_d2Action, *_d3Action, *_d4Action;
+  QAction *_t1Action, *_t5Action;
+  QAction *_threadsAction, *_ponderAction;
   QAction *_aboutAction;
   QActionGroup* _depthGroup;
   QStatusBar* _statusbar;
@@ -69,6 +80,8 @@ private:
   Board* _board;
   BoardWidget* _boardWidget;
   Network* _network;
+  SearchThread* _searchThread;
+  OpeningBook _book;
 };
 
 
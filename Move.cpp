@@ -38,7 +38,7 @@ QString Move::nameOfDir(int dir)
 
 QString Move::nameOfPos(int p)
 {
-    static char tmp[3];
+    char tmp[3];
     tmp[0] = 'A' + (p-12)/11;
     tmp[1] = '1' + (p-12)%11;
     tmp[2] = 0;
@@ -133,6 +133,64 @@ void InARowCounter::init()
 	count[i] = 0;
 }
 
+MoveOrder::MoveOrder()
+{
+    clear();
+}
+
+void MoveOrder::clear()
+{
+    int i, j;
+
+    for(i=0;i<MaxPly;i++)
+	for(j=0;j<KillerSlots;j++)
+	    _killer[i][j].type = Move::none;
+
+    for(i=0;i<121;i++)
+	for(j=0;j<7;j++)
+	    _history[i][j] = 0;
+}
+
+void MoveOrder::newSearch()
+{
+    int i, j;
+
+    for(i=0;i<MaxPly;i++)
+	for(j=0;j<KillerSlots;j++)
+	    _killer[i][j].type = Move::none;
+
+    /* old history is less reliable for the new position */
+    for(i=0;i<121;i++)
+	for(j=0;j<7;j++)
+	    _history[i][j] /= 4;
+}
+
+void MoveOrder::cutoff(const Move& m, int ply, int depthLeft)
+{
+    int i, j;
+
+    if (depthLeft < 1) depthLeft = 1;
+    int& h = _history[m.field][m.direction];
+    h += depthLeft * depthLeft;
+    if (h > MaxHistory)
+	for(i=0;i<121;i++)
+	    for(j=0;j<7;j++)
+		_history[i][j] /= 2;
+
+    /* push moves are tried early anyway */
+    if (m.isPushMove()) return;
+
+    if (ply >= MaxPly) ply = MaxPly-1;
+    Move* k = _killer[ply];
+    if (k[0].type == m.type && k[0].field == m.field &&
+	k[0].direction == m.direction)
+	return;
+    for(i=KillerSlots-1;i>0;i--)
+	k[i] = k[i-1];
+    k[0] = m;
+}
+
+
 MoveList::MoveList()
 {
     clear();
@@ -147,6 +205,7 @@ void MoveList::clear()
 
     nextUnused = 0;
     actualType = -1;
+    order = 0;
 }
 
 void MoveList::insert(Move m)
@@ -243,6 +302,20 @@ bool MoveList::isElement(Move &m, int startType,bool del)
 }
 
 
+/* index of exact match for <m>, or -1 */
+int MoveList::find(const Move& m)
+{
+    int i;
+
+    for(i=0; i<nextUnused; i++)
+	if (move[i].field == m.field &&
+	    move[i].direction == m.direction &&
+	    move[i].type == m.type)
+	    return i;
+
+    return -1;
+}
+
 bool MoveList::getNext(Move& m, int maxType)
 {
     if (actualType == Move::typeCount) return false;
@@ -254,6 +327,37 @@ bool MoveList::getNext(Move& m, int maxType)
 	    actual[actualType] = first[actualType];
 	    if (actualType > maxType) return false;
 	}
+
+	if (order) {
+	    /* killers come first among non-push moves */
+	    if (actualType > Move::maxPushType()) {
+		while(nextKiller < MoveOrder::KillerSlots) {
+		    const Move& k = order->killer(orderPly, nextKiller++);
+		    if (k.type == Move::none || k.type > maxType)
+			continue;
+		    int i = find(k);
+		    if (i < 0) continue;
+		    m = move[i];
+		    move[i].type = Move::none;
+		    return true;
+		}
+	    }
+
+	    /* move best by history to the front of the queue */
+	    int a = actual[actualType], best = a, i;
+	    int h = (move[a].type == Move::none) ? -1 : order->history(move[a]);
+	    for(i = next[a]; i != -1; i = next[i]) {
+		if (move[i].type == Move::none) continue;
+		int hi = order->history(move[i]);
+		if (hi > h) { h = hi; best = i; }
+	    }
+	    if (best != a) {
+		Move tmp = move[a];
+		move[a] = move[best];
+		move[best] = tmp;
+	    }
+	}
+
 	m = move[actual[actualType]];
 	actual[actualType] = next[actual[actualType]];
 	if (m.type != Move::none) break;
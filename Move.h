@@ -114,15 +114,52 @@ private:
 };
 
 
+/**
+ * Class MoveOrder
+ *
+ * Search feedback for move ordering: per ply, the last 2 quiet moves
+ * which produced a beta cutoff ("killers"), and a history score per
+ * start field and direction, increased on each cutoff.
+ * Used by MoveList::getNext (see MoveList::setOrder)
+ */
+class MoveOrder
+{
+public:
+    MoveOrder();
+
+    enum { MaxPly = 32, KillerSlots = 2, MaxHistory = 1<<24 };
+
+    /* forget everything */
+    void clear();
+    /* for a new search: forget killers and age history */
+    void newSearch();
+    /* move <m> at <ply> produced a cutoff with <depthLeft> plies
+     * searched below it */
+    void cutoff(const Move& m, int ply, int depthLeft);
+
+    const Move& killer(int ply, int slot) const
+    { return _killer[(ply<MaxPly) ? ply : MaxPly-1][slot]; }
+    int history(const Move& m) const
+    { return _history[m.field][m.direction]; }
+
+private:
+    Move _killer[MaxPly][KillerSlots];
+    int _history[121][7];
+};
+
+
 /**
  * Class MoveList
  *
  * Stores a fixed number of moves
  * <getNext> returns reference of next move ordered according to type
  * <insert> does nothing if there isn't enough free space
+ * With a MoveOrder set, the killers of the ply are returned before
+ * other non-push moves, and moves of the same type ordered by
+ * history score
  *
  * Recommend usage (* means 0 or more times):
- *   [ clear() ; insert() * ; isElement() * ; getNext() * ] *
+ *   [ clear() ; insert() * ; setOrder() ; isElement() * ; getNext() * ] *
  */
 class MoveList
 {
@@ -143,9 +180,17 @@ public:
     int getLength()
     { return nextUnused; }
 
+    /* use killers of <ply> and history from <o> (reset by clear) */
+    void setOrder(const MoveOrder* o, int ply)
+    { order = o; orderPly = ply; nextKiller = 0; }
+
     bool getNext(Move&,int maxType);  /* returns false if no more moves */
 
 private:
+    int find(const Move&);
+
+    const MoveOrder* order;
+    int  orderPly, nextKiller;
     Move move[MaxMoves];
     int  next[MaxMoves];
     int  first[Move::typeCount];
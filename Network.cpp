@@ -19,14 +19,16 @@
 /*
  * Simple Network Support
  *
- * Install a listening socket; receive positions on incoming
- * connections
+ * Install a listening socket; exchange positions with peers over
+ * persistent connections, see Network.h
  */
 
 #include "Network.h"
-#include "Board.h"      // for broadcast(Board*)
+#include "Board.h"      // for broadcast(Board*), move records
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -35,12 +37,35 @@
 #include <netdb.h>
 
 #include <QSocketNotifier>
+#include <QTimer>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static void setNonBlocking(int s)
+{
+    int flags = fcntl(s, F_GETFL, 0);
+    if (flags >= 0)
+	fcntl(s, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* no error on a socket with connect in progress */
+static bool connectOK(int s)
+{
+    int err = 0;
+    socklen_t sz = sizeof(err);
+    return (getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &sz) >= 0) && (err == 0);
+}
 
 Listener::Listener(const char* h, struct sockaddr_in s, bool r)
 {
     setHost(h);
     sin = s;
     reachable = r;
+    conn = 0;
+    failures = 0;
+    connected = false;
 }
 
 void Listener::setHost(const char* h)
@@ -60,11 +85,33 @@ int Listener::port()
     return ntohs(sin.sin_port);
 }
 
+Connection::Connection(int f, struct sockaddr_in s)
+{
+    fd = f;
+    sin = s;
+    peer = 0;
+    connecting = false;
+    sn = 0;
+    wsn = 0;
+}
+
+Connection::~Connection()
+{
+    delete sn;
+    delete wsn;
+    close(fd);
+}
+
 Network::Network(int port)
 {
     struct sockaddr_in name;
     int i,j;
 
+    sn = 0;
+    timer = 0;
+    board = 0;
+    seq = 0;
+    sentLast = false;
     fd = ::socket (PF_INET, SOCK_STREAM, 0);
     if (fd<0) return;
 
@@ -91,11 +138,16 @@ Network::Network(int port)
 	fd = -1;
 	return;
     }
+    setNonBlocking(fd);
 
     sn = new QSocketNotifier( fd, QSocketNotifier::Read );
     QObject::connect( sn, SIGNAL(activated(int)),
 		      this, SLOT(gotConnection()) );
-    sentPos = 0;
+
+    timer = new QTimer(this);
+    QObject::connect( timer, SIGNAL(timeout()),
+		      this, SLOT(keepAlive()) );
+    timer->start(keepAliveInterval);
 
     for(j = 0; j<i;j++)
 	addListener("127.0.0.1", port+j);
@@ -110,9 +162,11 @@ Network::~Network()
     int len = sprintf(tmp, "unreg %d", ntohs(mySin.sin_port));
 
     foreach (Listener* l, listeners) {
-	if (l->reachable)
-	    sendString( l->sin, tmp, len);
+	if (l->reachable && l->conn)
+	    sendString( l, tmp, len);
     }
+    qDeleteAll(connections);
+    connections.clear();
     qDeleteAll(listeners);
     listeners.clear();
 
@@ -127,10 +181,52 @@ Listener* Network::listenerMatch(struct sockaddr_in sin)
     return 0;
 }
 
+Connection* Network::addConnection(int s, struct sockaddr_in sin)
+{
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setNonBlocking(s);
+
+    Connection* c = new Connection(s, sin);
+    c->sn = new QSocketNotifier( s, QSocketNotifier::Read );
+    QObject::connect( c->sn, SIGNAL(activated(int)),
+		      this, SLOT(gotData(int)) );
+    /* only enabled while connecting or with queued data */
+    c->wsn = new QSocketNotifier( s, QSocketNotifier::Write );
+    c->wsn->setEnabled(false);
+    QObject::connect( c->wsn, SIGNAL(activated(int)),
+		      this, SLOT(gotWritable(int)) );
+    connections.append(c);
+
+    return c;
+}
+
+Connection* Network::findConnection(int s)
+{
+    foreach (Connection* c, connections)
+	if (c->fd == s) return c;
+    return 0;
+}
+
+void Network::closeConnection(Connection* c)
+{
+    foreach (Listener* l, listeners)
+	if (l->conn == c) l->conn = 0;
+
+    connections.removeOne(c);
+    delete c;
+}
+
+void Network::removeListener(Listener* l)
+{
+    listeners.removeOne(l);
+    foreach (Connection* c, connections)
+	if (c->peer == l) c->peer = 0;
+    delete l;
+}
+
 void Network::gotConnection()
 {
-    static char tmp[1024];
-    int len=0;
     struct sockaddr_in sin;
     socklen_t sz = sizeof (sin);
 
@@ -142,15 +238,106 @@ void Network::gotConnection()
     //  qDebug("GotConnection: ");
     int s = accept(fd,(struct sockaddr *)&sin, &sz);
     if (s<0) {
-	qDebug("Error in accept\n");
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	    qDebug("Error in accept\n");
 	return;
     }
-    while(read(s, tmp+len, 1)==1) len++;
-    close(s);
-    tmp[len]=0; len++;
-    //  qDebug("Got: '%s'\n",tmp);
-    if (strncmp(tmp,"reg ",4)==0) {
-	int port = atoi(tmp+4);
+    addConnection(s, sin);
+}
+
+/* data from a connection: read all available, handle complete messages */
+void Network::gotData(int s)
+{
+    char buf[4096];
+    Connection* c = findConnection(s);
+    if (!c) return;
+
+    /* failed connect also signals readability */
+    if (c->connecting && !connectOK(s)) {
+	connectFailed(c);
+	return;
+    }
+
+    while(1) {
+	int len = read(s, buf, sizeof(buf));
+	if (len < 0) {
+	    if (errno == EINTR) continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+	}
+	if (len <= 0) {
+	    /* closed by peer: reconnect on next message/keep-alive */
+	    closeConnection(c);
+	    return;
+	}
+	c->in.append(buf, len);
+
+	int end;
+	while((end = c->in.indexOf('\0')) >= 0) {
+	    QByteArray msg = c->in.left(end);
+	    c->in.remove(0, end+1);
+	    handleMessage(c, msg.constData());
+	    /* connection may be closed by handling */
+	    if (!connections.contains(c)) return;
+	}
+	if (c->in.size() > maxMessageSize) {
+	    qDebug("gotData: message too large\n");
+	    closeConnection(c);
+	    return;
+	}
+	if (len < (int)sizeof(buf)) return;
+    }
+}
+
+/* connect finished, or queued data can be written */
+void Network::gotWritable(int s)
+{
+    Connection* c = findConnection(s);
+    if (!c) return;
+
+    if (c->connecting) {
+	if (!connectOK(s)) {
+	    connectFailed(c);
+	    return;
+	}
+	c->connecting = false;
+	if (c->peer) {
+	    c->peer->connected = true;
+	    c->peer->failures = 0;
+	}
+    }
+    flush(c);
+}
+
+/* drop connections which could not be established in time */
+void Network::checkConnects()
+{
+    foreach (Connection* c, connections)
+	if (c->connecting && c->started.elapsed() >= connectTimeout)
+	    connectFailed(c);
+}
+
+void Network::connectFailed(Connection* c)
+{
+    Listener* l = c->peer;
+
+    qDebug("Error in connect to 0x%x:%d\n",
+	   ntohl(c->sin.sin_addr.s_addr), ntohs(c->sin.sin_port) );
+    closeConnection(c);
+    if (!l) return;
+
+    if (!l->connected)
+	/* never reached, e.g. from addListener */
+	removeListener(l);
+    else if (++l->failures > maxFailures)
+	l->reachable = false;
+}
+
+void Network::handleMessage(Connection* c, const char* msg)
+{
+    //  qDebug("Got: '%s'\n",msg);
+    if (strncmp(msg,"reg ",4)==0) {
+	struct sockaddr_in sin = c->sin;
+	int port = atoi(msg+4);
 	sin.sin_port = htons( port );
 	Listener* l = listenerMatch(sin);
 	if (l)
@@ -162,19 +349,25 @@ void Network::gotConnection()
 	//    qDebug("Reg of 0x%x:%d\n",
 	//	   ntohl(sin.sin_addr.s_addr ), ntohs(sin.sin_port));
 
-	if (sentPos)
-	    l->reachable = sendString(l->sin, sentPos, sentLen);
+	/* use connection from peer for sending, too */
+	c->peer = l;
+	l->failures = 0;
+	l->connected = true;
+	if (!l->conn) l->conn = c;
+
+	if (sentLast)
+	    sendPosition(l);
 
 	return;
     }
 
-    if (strncmp(tmp,"unreg ",6)==0) {
-	int port = atoi(tmp+6);
+    if (strncmp(msg,"unreg ",6)==0) {
+	struct sockaddr_in sin = c->sin;
+	int port = atoi(msg+6);
 	sin.sin_port = htons( port );
 	Listener* l = listenerMatch(sin);
 	if (l) {
-	    listeners.removeOne(l);
-	    delete l;
+	    removeListener(l);
 	    //    qDebug("UnReg of 0x%x:%d\n",
 	    //	   ntohl(sin.sin_addr.s_addr), ntohs(sin.sin_port));
 	}
@@ -184,9 +377,102 @@ void Network::gotConnection()
 	return;
     }
 
-    if (strncmp(tmp,"pos ",4)==0) {
-	sentPos = 0;
-	emit gotPosition(tmp+4);
+    if (strncmp(msg,"move ",5)==0) {
+	handleMove(c, msg+5);
+	return;
+    }
+
+    if (strncmp(msg,"pos ",4)==0) {
+	char* state;
+	int s = strtol(msg+4, &state, 10);
+	if (*state != ' ') {
+	    qDebug("Error: Position without number\n");
+	    return;
+	}
+	seq = s;
+	sentLast = false;
+	sentPos.clear();
+	emit gotPosition(state+1);
+	return;
+    }
+
+    if (strcmp(msg,"get")==0) {
+	if (c->peer) sendPosition(c->peer);
+	return;
+    }
+
+    /* "ping" is sent for keep-alive only */
+}
+
+/* play move record if it follows our position, otherwise resync */
+void Network::handleMove(Connection* c, const char* msg)
+{
+    int s, f, d, t;
+    unsigned long long hash;
+
+    if (sscanf(msg, "%d %d %d %d %llx", &s, &f, &d, &t, &hash) != 5) {
+	qDebug("Error: Bad move record '%s'\n", msg);
+	return;
+    }
+    if (!board || s != seq+1) {
+	/* missed a position */
+	requestPosition(c);
+	return;
+    }
+
+    MoveList list;
+    Move m;
+    bool found = false;
+    board->generateMoves(list);
+    while(!found && list.getNext(m, Move::none))
+	found = (m.field == f) && (m.direction == d) && (m.type == t);
+    if (!found) {
+	requestPosition(c);
+	return;
+    }
+
+    seq = s;
+    sentLast = false;
+    emit gotMove(m);
+    if (board->hashKey() != hash)
+	requestPosition(c);
+}
+
+/* ask peer of <c> for its full state */
+void Network::requestPosition(Connection* c)
+{
+    //  qDebug("Resync with 0x%x:%d\n",
+    //	 ntohl(c->sin.sin_addr.s_addr), ntohs(c->sin.sin_port));
+    if (c->peer)
+	sendString(c->peer, "get", 3);
+}
+
+/* send full state of current position to <l> */
+void Network::sendPosition(Listener* l)
+{
+    char tmp[20];
+    sprintf(tmp, "pos %d ", seq);
+
+    QByteArray msg(tmp);
+    if (board)
+	msg += board->getState().toLatin1();
+    else
+	msg += sentPos;
+    l->reachable = sendString(l, msg.constData(), msg.size());
+}
+
+/* keep connections alive, reconnect to reachable listeners */
+void Network::keepAlive()
+{
+    foreach (Listener* l, listeners) {
+	if (!l->reachable) continue;
+
+	if (l->conn) {
+	    if (!l->conn->connecting)
+		sendString(l, "ping", 4);
+	}
+	else if (!connectTo(l) && ++l->failures > maxFailures)
+	    l->reachable = false;
     }
 }
 
@@ -209,6 +495,7 @@ void Network::addListener(const char* host, int port)
     if (l) {
 	l->reachable = true;
 	l->setHost(host);
+	if (l->conn) return;
     }
     else {
 	l = new Listener(host, sin);
@@ -217,13 +504,9 @@ void Network::addListener(const char* host, int port)
 	//	 host, ntohl(name.sin_addr.s_addr), ntohs(name.sin_port));
     }
 
-    char tmp[50];
-    int len = sprintf(tmp, "reg %d", ntohs(mySin.sin_port));
-
-    if (!sendString( sin, tmp, len)) {
-	listeners.removeOne(l);
-	delete l;
-    }
+    /* registers us at the listener; removed again if connect fails */
+    if (!connectTo(l))
+	removeListener(l);
 }
 
 void Network::addListener(const char *a)
@@ -243,16 +526,19 @@ void Network::addListener(const char *a)
 
 void Network::broadcast(const char* pos)
 {
-    static char tmp[1024];
-    int len = sprintf(tmp,"pos %s", pos);
+    seq++;
+    sentLast = true;
+    sentPos = pos;
+
+    char tmp[20];
+    sprintf(tmp, "pos %d ", seq);
+    QByteArray msg(tmp);
+    msg += pos;
 
     foreach (Listener* l, listeners) {
 	if (l->reachable)
-	    l->reachable = sendString(l->sin, tmp, len);
+	    l->reachable = sendString(l, msg.constData(), msg.size());
     }
-
-    sentPos = tmp;
-    sentLen = len;
 }
 
 void Network::broadcast(Board *b)
@@ -260,30 +546,94 @@ void Network::broadcast(Board *b)
     broadcast(qPrintable(b->getState()));
 }
 
-bool Network::sendString(struct sockaddr_in sin, const char* str, int len)
+void Network::broadcastMove(const Move& m)
+{
+    if (!board) {
+	qDebug("Error: broadcastMove without board\n");
+	return;
+    }
+
+    seq++;
+    sentLast = true;
+    sentPos.clear();
+
+    char tmp[100];
+    int len = sprintf(tmp, "move %d %d %d %d %llx", seq,
+		      m.field, m.direction, m.type,
+		      (unsigned long long) board->hashKey());
+
+    foreach (Listener* l, listeners) {
+	if (l->reachable)
+	    l->reachable = sendString(l, tmp, len);
+    }
+}
+
+/* start connecting to listener <l>, registering with our port */
+bool Network::connectTo(Listener* l)
 {
     int s = ::socket (PF_INET, SOCK_STREAM, 0);
     if (s<0) {
-	qDebug("Error in sendString/socket ??\n");
+	qDebug("Error in connectTo/socket ??\n");
 	return false;
     }
-    if (::connect (s, (struct sockaddr *)&sin, sizeof (sin)) <0) {
-	qDebug("Error in sendString/connect to socket 0x%x:%d\n",
-	       ntohl(sin.sin_addr.s_addr), ntohs(sin.sin_port) );
+    setNonBlocking(s);
+    if (::connect (s, (struct sockaddr *)&l->sin, sizeof (l->sin)) <0 &&
+	errno != EINPROGRESS) {
+	qDebug("Error in connectTo/connect to socket 0x%x:%d\n",
+	       ntohl(l->sin.sin_addr.s_addr), ntohs(l->sin.sin_port) );
+	close(s);
 	return false;
     }
-    while(len>0) {
-	int written = write(s, str, len);
+    Connection* c = addConnection(s, l->sin);
+    c->peer = l;
+    c->connecting = true;
+    c->started.start();
+    c->wsn->setEnabled(true);
+    l->conn = c;
+    QTimer::singleShot(connectTimeout, this, SLOT(checkConnects()));
+
+    char tmp[50];
+    int len = sprintf(tmp, "reg %d", ntohs(mySin.sin_port));
+    return sendString(l, tmp, len);
+}
+
+/* queue message <str> for <l>, connecting if needed */
+bool Network::sendString(Listener* l, const char* str, int len)
+{
+    if (!l->conn && !connectTo(l))
+	return false;
+
+    Connection* c = l->conn;
+    if (c->out.size() + len >= maxQueueSize) {
+	qDebug("sendString: peer 0x%x:%d too slow\n",
+	       ntohl(l->sin.sin_addr.s_addr), ntohs(l->sin.sin_port) );
+	closeConnection(c);
+	return false;
+    }
+    c->out.append(str, len+1); /* including terminating 0 */
+    //  qDebug("Send '%s' to 0x%x:%d\n", str,
+    //	 ntohl(l->sin.sin_addr.s_addr), ntohs(l->sin.sin_port) );
+    if (c->connecting) return true;
+    return flush(c);
+}
+
+/* write as much queued data as possible without blocking */
+bool Network::flush(Connection* c)
+{
+    while(!c->out.isEmpty()) {
+	int written = send(c->fd, c->out.constData(), c->out.size(),
+			   MSG_NOSIGNAL);
+	if (written < 0) {
+	    if (errno == EINTR) continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+	}
 	if (written <= 0) {
-	    qDebug("sendString: Error in write\n");
-	    break;
+	    qDebug("flush: Error in write\n");
+	    closeConnection(c);
+	    return false;
 	}
-	str += written;
-	len -= written;
+	c->out.remove(0, written);
     }
-    close(s);
-    //  qDebug("Send '%s' to 0x%x:%d\n", str,
-    //	 ntohl(sin.sin_addr.s_addr), ntohs(sin.sin_port) );
+    c->wsn->setEnabled(!c->out.isEmpty());
     return true;
 }
-
@@ -19,8 +19,21 @@
 /*
  * Simple Network Support
  *
- * Install a listening socket; receive positions on incoming
- * connections
+ * Install a listening socket; exchange positions with listeners
+ * (peers) over long-lived TCP connections. Messages on a connection
+ * are terminated by a 0 byte. The first message on a connection
+ * opened by a peer is "reg <port>", with the port it listens on.
+ *
+ * Positions of the shared game are numbered. After a move, only a
+ * move record "move <seq> <field> <direction> <type> <hash>" is sent,
+ * with <seq> the number and <hash> the Board::hashKey() of the
+ * resulting position. The full state "pos <seq> <state>" is sent on a
+ * new game, to newly registered peers, and on request ("get") by a
+ * peer which missed a position or got another hash after the move.
+ *
+ * All sockets are non-blocking: connects complete asynchronously,
+ * and outgoing messages are queued per connection and written when
+ * the socket gets writable.
  */
 
 #ifndef _NETWORK_H_
@@ -31,6 +44,15 @@
 
 #include <QObject>
 #include <QList>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include "Move.h"
+
+class QSocketNotifier;
+class QTimer;
+class Board;
+class Connection;
 
 class Listener {
 public:
@@ -42,11 +64,27 @@ public:
     char host[100];
     struct sockaddr_in sin;
     bool reachable;
+    Connection* conn;     /* used for sending, 0 if not connected */
+    int failures;         /* reconnects failed in a row */
+    bool connected;       /* a connection was established once */
 };
 
+/* TCP connection to a peer, opened by us or by the peer */
+class Connection {
+public:
+    Connection(int fd, struct sockaddr_in sin);
+    ~Connection();
+
+    int fd;
+    struct sockaddr_in sin;   /* address of remote end */
+    Listener* peer;           /* 0 until registered */
+    bool connecting;          /* connect in progress */
+    QElapsedTimer started;    /* start of connect */
+    QSocketNotifier *sn, *wsn;
+    QByteArray in;            /* received, not yet complete message */
+    QByteArray out;           /* queued, not yet written */
+};
 
-class QSocketNotifier;
-class Board;
 
 class Network: public QObject
 {
@@ -55,6 +93,14 @@ class Network: public QObject
 public:
     enum { defaultPort = 23412 };
 
+    /* Keep-alive message interval (ms); a listener is given up after
+     * maxFailures reconnects failed in a row. A connection is dropped
+     * if connecting takes longer than connectTimeout (ms), or if more
+     * than maxQueueSize bytes wait for being sent to a slow peer */
+    enum { keepAliveInterval = 20000, maxFailures = 15,
+	   connectTimeout = 5000,
+	   maxMessageSize = 65536, maxQueueSize = 1048576 };
+
     /* install listening TCP socket on port */
     Network(int port = defaultPort);
     ~Network();
@@ -64,23 +110,50 @@ public:
     void addListener(const char* host, int port);
     void broadcast(const char* pos);
     void broadcast(Board* b);
+    /* send move record after m was played on board set by setBoard() */
+    void broadcastMove(const Move& m);
+
+    /* board kept in sync: moves received are checked against it, and
+     * its state is sent to peers on request */
+    void setBoard(Board* b) { board = b; }
 
 signals:
     void gotPosition(const char* pos);
+    /* board set by setBoard() is expected to play the move */
+    void gotMove(Move m);
 
 private slots:
     void gotConnection();
+    void gotData(int fd);
+    void gotWritable(int fd);
+    void checkConnects();
+    void keepAlive();
 
 private:
-    bool sendString(struct sockaddr_in sin, const char* str, int len);
+    bool sendString(Listener* l, const char* str, int len);
+    bool connectTo(Listener* l);
+    void connectFailed(Connection* c);
+    bool flush(Connection* c);
+    Connection* addConnection(int fd, struct sockaddr_in sin);
+    Connection* findConnection(int fd);
+    void closeConnection(Connection* c);
+    void removeListener(Listener* l);
+    void handleMessage(Connection* c, const char* msg);
+    void handleMove(Connection* c, const char* msg);
+    void sendPosition(Listener* l);
+    void requestPosition(Connection* c);
     Listener *listenerMatch(sockaddr_in sin);
 
     QList<Listener*> listeners;
+    QList<Connection*> connections;
     struct sockaddr_in mySin;
     int fd, myPort;
     QSocketNotifier *sn;
-    const char* sentPos;
-    int sentLen;
+    QTimer *timer;
+    QByteArray sentPos;   /* last full state broadcasted */
+    Board* board;
+    int seq;              /* number of current position */
+    bool sentLast;        /* last position was sent by us */
 };
 
 #endif // _NETWORK_H_
@@ -0,0 +1,179 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+
+/* Opening book, memory-mapped */
+
+#include <QtEndian>
+#include <QtAlgorithms>
+#include <string.h>
+
+#include "OpeningBook.h"
+
+static const char bookMagic[] = "QNLBOOK1";
+
+OpeningBook::OpeningBook()
+{
+    _entries = 0;
+    _count = 0;
+}
+
+OpeningBook::~OpeningBook()
+{
+    close();
+}
+
+bool OpeningBook::open(const QString& file)
+{
+    close();
+
+    _file.setFileName(file);
+    if (!_file.open(QIODevice::ReadOnly))
+	return false;
+
+    qint64 size = _file.size();
+    const uchar* data = 0;
+    if (size >= HeaderSize)
+	data = _file.map(0, size);
+    if (!data || memcmp(data, bookMagic, 8) != 0) {
+	_file.close();
+	return false;
+    }
+
+    quint32 count = qFromLittleEndian<quint32>(data + 8);
+    if ((qint64) count * EntrySize != size - HeaderSize) {
+	qWarning("Opening book %s: wrong size", qPrintable(file));
+	_file.close();
+	return false;
+    }
+
+    _entries = data + HeaderSize;
+    _count = count;
+    return true;
+}
+
+void OpeningBook::close()
+{
+    /* unmaps the file, too */
+    _file.close();
+    _entries = 0;
+    _count = 0;
+}
+
+quint64 OpeningBook::key(int i) const
+{
+    return qFromLittleEndian<quint64>(_entries + i * EntrySize);
+}
+
+void OpeningBook::entry(int i, BookEntry& e) const
+{
+    const uchar* p = _entries + i * EntrySize;
+
+    e.key = qFromLittleEndian<quint64>(p);
+    e.move.field = qFromLittleEndian<quint16>(p + 8);
+    e.move.direction = p[10];
+    e.move.type = (Move::MoveType) p[11];
+    e.weight = qFromLittleEndian<quint32>(p + 12);
+}
+
+int OpeningBook::lowerBound(quint64 k) const
+{
+    int lo = 0, hi = _count;
+
+    while(lo < hi) {
+	int mid = (lo + hi) / 2;
+	if (key(mid) < k) lo = mid + 1;
+	else hi = mid;
+    }
+    return lo;
+}
+
+int OpeningBook::lookup(quint64 k, QVector<BookEntry>& list) const
+{
+    BookEntry e;
+    int i, found = 0;
+
+    for(i = lowerBound(k); i < _count && key(i) == k; i++, found++) {
+	entry(i, e);
+	list.append(e);
+    }
+    return found;
+}
+
+Move OpeningBook::choose(quint64 k, int r) const
+{
+    QVector<BookEntry> list;
+    Move m;
+    int i, sum = 0;
+
+    lookup(k, list);
+    for(i = 0; i < list.size(); i++)
+	sum += list[i].weight;
+    if (sum <= 0) return m;
+
+    r %= sum;
+    for(i = 0; i < list.size(); i++) {
+	r -= list[i].weight;
+	if (r < 0) break;
+    }
+    return list[i].move;
+}
+
+static bool entryLessThan(const BookEntry& a, const BookEntry& b)
+{
+    if (a.key != b.key) return a.key < b.key;
+    if (a.move.field != b.move.field) return a.move.field < b.move.field;
+    if (a.move.direction != b.move.direction)
+	return a.move.direction < b.move.direction;
+    return a.move.type < b.move.type;
+}
+
+bool OpeningBook::write(const QString& file, QVector<BookEntry> list)
+{
+    QVector<BookEntry> merged;
+    int i;
+
+    qSort(list.begin(), list.end(), entryLessThan);
+    for(i = 0; i < list.size(); i++) {
+	if (!merged.isEmpty() &&
+	    !entryLessThan(merged.last(), list[i]))
+	    merged.last().weight += list[i].weight;
+	else
+	    merged.append(list[i]);
+    }
+
+    QByteArray data(HeaderSize + merged.size() * EntrySize, 0);
+    uchar* p = (uchar*) data.data();
+
+    memcpy(p, bookMagic, 8);
+    qToLittleEndian<quint32>(merged.size(), p + 8);
+    p += HeaderSize;
+    for(i = 0; i < merged.size(); i++, p += EntrySize) {
+	const BookEntry& e = merged[i];
+	qToLittleEndian<quint64>(e.key, p);
+	qToLittleEndian<quint16>(e.move.field, p + 8);
+	p[10] = e.move.direction;
+	p[11] = e.move.type;
+	qToLittleEndian<quint32>(e.weight, p + 12);
+    }
+
+    QFile f(file);
+    if (!f.open(QIODevice::WriteOnly))
+	return false;
+    return f.write(data) == data.size();
+}
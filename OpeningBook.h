@@ -0,0 +1,87 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+
+/*
+ * Opening book
+ *
+ * Weighted moves for positions given by their Zobrist key (see
+ * Board::hashKey). A book is generated offline by self-play (see
+ * bookmain.cpp) and memory-mapped read-only: the entries are sorted
+ * by key for binary search, with all moves of a position adjacent.
+ *
+ * File format, numbers in little endian:
+ *   header   "QNLBOOK1", quint32 entry count, quint32 unused
+ *   entry    quint64 key, quint16 field, quint8 direction,
+ *            quint8 move type, quint32 weight
+ */
+
+#ifndef _OPENINGBOOK_H_
+#define _OPENINGBOOK_H_
+
+#include <QFile>
+#include <QVector>
+#include "Move.h"
+
+class BookEntry
+{
+public:
+    quint64 key;
+    Move move;
+    int weight;
+};
+
+
+class OpeningBook
+{
+public:
+    OpeningBook();
+    ~OpeningBook();
+
+    /* Map book <file>; returns false if not existing or invalid */
+    bool open(const QString& file);
+    void close();
+    bool isOpen() const { return _entries != 0; }
+    int size() const { return _count; }
+
+    /* All moves for position with <key>, appended to <list> */
+    int lookup(quint64 key, QVector<BookEntry>& list) const;
+
+    /* Move for position with <key>, chosen with probability according
+     * to weights by random number <r> (>= 0); Move::none if position
+     * is not in book */
+    Move choose(quint64 key, int r) const;
+
+    /* Write <list> as book <file>. Entries with same key and move
+     * are merged, adding weights */
+    static bool write(const QString& file, QVector<BookEntry> list);
+
+private:
+    enum { HeaderSize = 16, EntrySize = 16 };
+
+    quint64 key(int i) const;
+    void entry(int i, BookEntry&) const;
+    /* first entry with key not less than <key> */
+    int lowerBound(quint64 key) const;
+
+    QFile _file;
+    const uchar* _entries;
+    int _count;
+};
+
+#endif /* _OPENINGBOOK_H_ */
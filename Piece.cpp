@@ -24,10 +24,22 @@
 #include <math.h>
 
 #include <QTimer>
-#include <QBitmap>
 #include <QImage>
 #include <QPixmap>
 #include <QPainter>
+#include <QPaintEvent>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QDir>
+#include <QFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
 
 #include "Piece.h"
 
@@ -36,6 +48,8 @@ int Piece::sizeX, Piece::sizeY;
 double Piece::lightX, Piece::lightY, Piece::lightZ;
 QColor Piece::lightColor;
 double Piece::rippleCount, Piece::rippleDepth;
+QString Piece::cacheDir;
+bool Piece::cacheDirSet = false;
 
 /* set global Piece parameter */
 void Piece::setSize(int x, int y)
@@ -95,6 +109,7 @@ Piece::Piece(const QColor& c, double a, int t)
     sina = sin(a), cosa = cos(a);
 
     tex = t;
+    saved = false;
 
     next = first;
     first = this;
@@ -117,77 +132,244 @@ Piece::~Piece()
 QPixmap* Piece::pixmap()
 {
     if (pm.isNull() && sizeX>0 && sizeY>0)
-	render();
+	renderAll();
     return &pm;
 }
 
-void Piece::render()
+/* Renders the image of one piece in the global thread pool */
+class PieceRenderer: public QRunnable
 {
-    int x,y;
-    double xx,yy,zz, ll,lll, red,green,blue;
+public:
+    PieceRenderer(Piece* p, QSemaphore* d) { piece = p; done = d; }
+
+    void run()
+    {
+	QString file;
+	if (!Piece::cacheDir.isEmpty()) {
+	    file = piece->cacheFile();
+	    if (piece->loadCached(file)) {
+		done->release();
+		return;
+	    }
+	}
+	piece->image = piece->renderImage();
+	if (!file.isEmpty())
+	    piece->saved = piece->saveCached(file);
+	done->release();
+    }
+
+private:
+    Piece* piece;
+    QSemaphore* done;
+};
+
+/* After a resize, all pieces usually are needed for the next frames.
+ * Images are rendered in parallel; pixmaps only can be created in the
+ * GUI thread */
+void Piece::renderAll()
+{
+    QList<Piece*> todo;
+    QSemaphore done;
+    Piece *b;
 
     if (sizeX==0 || sizeY==0)
 	return;
 
-    QImage image(sizeX,sizeY, QImage::Format_RGB32);
-    image.fill(0);
+    if (!cacheDirSet) {
+#if QT_VERSION >= 0x050000
+	QString d = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+	QString d = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+	setCacheDir(d.isEmpty() ? d : d + "/pieces");
+    }
 
-    double vv=2./(sizeX+sizeY);
+    for(b=first;b!=0;b=b->next)
+	if (b->pm.isNull()) {
+	    b->saved = false;
+	    todo.append(b);
+	}
 
-    /* Go through all pixels, mapping x/y to (-1..1,-1..1) */
-    for(y=0;y<sizeY;y++) {
-	yy = (2.*y-sizeY)/(sizeY-2) *zoom;
-	for(x=0;x<sizeX;x++) {
-	    xx = (2.*x-sizeX)/(sizeX-2) *zoom;
+    foreach(b, todo)
+	QThreadPool::globalInstance()->start(new PieceRenderer(b, &done));
+    done.acquire(todo.count());
 
-	    /* Change only if inside the Piece */
-	    zz = 1 - (xx*xx + yy*yy);
+    bool saved = false;
+    foreach(b, todo) {
+	b->pm = QPixmap::fromImage( b->image );
+	b->image = QImage();
+	if (b->saved) saved = true;
+    }
+    if (saved)
+	pruneCache();
+}
 
-	    if (zz>flip) zz=2*flip-zz;
-	    else {
-		zz -= limit;
-	    }
+void Piece::setCacheDir(const QString& d)
+{
+    cacheDir = d;
+    cacheDirSet = true;
+    if (!d.isEmpty() && !QDir().mkpath(d))
+	cacheDir = QString();
+}
 
-	    if (zz>-vv) {
-		zz = (zz<0) ? 0 : sqrt(zz);
+/* File name in the cache is a hash of all parameters for rendering */
+QString Piece::cacheFile() const
+{
+    QByteArray key;
+    QDataStream s(&key, QIODevice::WriteOnly);
 
-		/* ll: light intensity at this point */
-		ll = xx*lightX + yy*lightY + zz*lightZ;
+    s << (qint32) CacheVersion << (qint32) sizeX << (qint32) sizeY
+      << (quint32) bColor.rgb() << an << (qint32) tex
+      << lightX << lightY << lightZ << (quint32) lightColor.rgb()
+      << rippleCount << rippleDepth << zoom << flip << limit;
 
-		/* some face modification */
-		double mapx = xx*(2-zz);
-		double mapy = yy*(2-zz);
-		double rmapx =  cosa*mapx + sina*mapy; /* rotate */
-		double rmapy = -sina*mapx + cosa*mapy;
+    QByteArray hash = QCryptographicHash::hash(key, QCryptographicHash::Md5);
+    return cacheDir + "/" + hash.toHex() + ".piece";
+}
 
-		if (tex>0)
-		    ll += rippleDepth* cos(rippleCount*rmapx)*cos(rippleCount*rmapy);
+/* Cache file format: 3 ints (version, width, height) in host byte order,
+ * followed by the pixels of the image */
+bool Piece::loadCached(const QString& file)
+{
+    QFile f(file);
+    qint32 header[3];
+
+    if (!f.open(QIODevice::ReadOnly))
+	return false;
+    if (f.read((char*)header, sizeof(header)) != sizeof(header) ||
+	header[0] != CacheVersion ||
+	header[1] != sizeX || header[2] != sizeY)
+	return false;
+
+    QImage img(sizeX, sizeY, QImage::Format_ARGB32_Premultiplied);
+    qint64 len = qint64(img.bytesPerLine()) * sizeY;
+    if (f.size() != (qint64)sizeof(header) + len ||
+	f.read((char*)img.bits(), len) != len)
+	return false;
+
+    image = img;
+    return true;
+}
 
-		ll = (ll<0.01) ? 0.0 : (ll>.99) ? 1.0 : ll;
-		lll = ll*ll;
+/* written under a temporary name first: pieces with the same
+ * parameters may be saved in parallel */
+bool Piece::saveCached(const QString& file) const
+{
+    QString tmp = QString("%1.%2").arg(file).arg((quintptr)this, 0, 16);
+    QFile f(tmp);
+    qint32 header[3] = { CacheVersion, sizeX, sizeY };
+    qint64 len = qint64(image.bytesPerLine()) * sizeY;
+
+    if (!f.open(QIODevice::WriteOnly))
+	return false;
+    bool ok = (f.write((const char*)header, sizeof(header)) == sizeof(header)) &&
+	(f.write((const char*)image.constBits(), len) == len);
+    f.close();
+    if (!ok || !QFile::rename(tmp, file)) {
+	QFile::remove(tmp);
+	return false;
+    }
+    return true;
+}
 
-		//	printf("x %f, y %f, z %f : ll %f lll %f\n", xx,yy,zz,ll,lll);
+/* Remove oldest files if the cache gets larger than MaxCacheSize */
+void Piece::pruneCache()
+{
+    QDir dir(cacheDir);
+    QFileInfoList files = dir.entryInfoList(QStringList("*.piece"), QDir::Files,
+					    QDir::Time);
+    qint64 size = 0;
+
+    /* newest first */
+    foreach(const QFileInfo& fi, files) {
+	size += fi.size();
+	if (size > MaxCacheSize)
+	    QFile::remove(fi.absoluteFilePath());
+    }
+}
 
+/* Cosine for the ripple texture, without branches and library calls
+ * to allow vectorization. Error is below 1e-5 */
+static inline float rippleCos(float x)
+{
+    /* t: x in periods, reduced to [0,0.5] (cos is symmetric) */
+    float t = fabsf(x * 0.15915494f);
+    t = fabsf(t - (float)(int)(t + .5f));
+
+    /* cos(2pi t) = -cos(2pi (0.5-t)): use argument in [0,pi/2] */
+    float sign = (t > .25f) ? -1.f : 1.f;
+    float t2 = .5f - t;
+    float a = 6.2831853f * ((t > .25f) ? t2 : t);
+    float a2 = a*a;
+
+    return sign * (1.f + a2*(-1.f/2 + a2*(1.f/24 + a2*(-1.f/720 +
+							 a2*(1.f/40320)))));
+}
 
-		/* mix Piece+light */
-		red   = lll * lightColor.red() +   (1-lll) * bColor.red();
-		green = lll * lightColor.green() + (1-lll) * bColor.green();
-		blue  = lll * lightColor.blue() +  (1-lll) * bColor.blue();
+QImage Piece::renderImage() const
+{
+    int x,y;
+    const int w = sizeX, h = sizeY;
+
+    /* transparent outside of the piece */
+    QImage image(w,h, QImage::Format_ARGB32_Premultiplied);
+
+    const float vv = 2.f/(w+h);
+    const float fl = flip, lim = limit;
+    const float lx = lightX, ly = lightY, lz = lightZ;
+    const float rc = rippleCount, rd = (tex>0) ? rippleDepth : 0.f;
+    const float sa = sina, ca = cosa;
+    const float br = bColor.red(), bg = bColor.green(), bb = bColor.blue();
+    const float lr = lightColor.red(), lg = lightColor.green();
+    const float lb = lightColor.blue();
+
+    /* Map x/y to (-1..1,-1..1) */
+    QVector<float> xmap(w);
+    for(x=0;x<w;x++)
+	xmap[x] = float(2.*x-w)/(w-2) *zoom;
+
+    /* Whole scanlines, without branches in the inner loop.
+     * Both sides of a selection are calculated to allow vectorization */
+    for(y=0;y<h;y++) {
+	const float yy = float(2.*y-h)/(h-2) *zoom;
+	const float* xs = xmap.constData();
+	QRgb* line = (QRgb*) image.scanLine(y);
+
+	for(x=0;x<w;x++) {
+	    float xx = xs[x];
+	    float zz = 1 - (xx*xx + yy*yy);
+	    float zflip = 2*fl-zz, zlim = zz-lim;
+	    zz = (zz>fl) ? zflip : zlim;
 
-		/* lightness */
-		red   = .2 * bColor.red()   + .8 * ll * red;
-		green = .2 * bColor.green() + .8 * ll * green;
-		blue  = .2 * bColor.blue()  + .8 * ll * blue;
+	    /* Change only if inside the Piece */
+	    bool inside = (zz>-vv);
+	    zz = sqrtf( (zz<0) ? 0.f : zz );
 
-		image.setPixel(x,y, qRgb( (int)red,  (int)green, (int)blue ));
-	    }
+	    /* ll: light intensity at this point */
+	    float ll = xx*lx + yy*ly + zz*lz;
+
+	    /* some face modification */
+	    float mapx = xx*(2-zz);
+	    float mapy = yy*(2-zz);
+	    float rmapx =  ca*mapx + sa*mapy; /* rotate */
+	    float rmapy = -sa*mapx + ca*mapy;
+
+	    ll += rd * rippleCos(rc*rmapx) * rippleCos(rc*rmapy);
+
+	    ll = (ll<0.01f) ? 0.f : (ll>.99f) ? 1.f : ll;
+	    float lll = ll*ll;
+
+	    /* mix Piece+light, then lightness */
+	    float red   = .2f * br + .8f * ll * (lll * lr + (1-lll) * br);
+	    float green = .2f * bg + .8f * ll * (lll * lg + (1-lll) * bg);
+	    float blue  = .2f * bb + .8f * ll * (lll * lb + (1-lll) * bb);
+
+	    QRgb rgb = qRgb( (int)red, (int)green, (int)blue );
+	    line[x] = inside ? rgb : 0;
 	}
     }
-    const QImage iMask = image.createHeuristicMask();
-    QBitmap bMask;
-    bMask = QBitmap::fromImage( iMask );
-    pm = QPixmap::fromImage( image );
-    pm.setMask(bMask);
+
+    return image;
 }
 
 
@@ -229,14 +411,17 @@ PieceAnimation::~PieceAnimation()
 
 
 /* Class PiecePosition */
-PiecePosition::PiecePosition(int xp,int yp, Piece* d)
+PiecePosition::PiecePosition(int n, int xp,int yp, Piece* d)
 {
+    no=n;
     x=xp;
     y=yp;
     def=d;
     actStep = -1;
     actType = ANIMATION_STOPPED;
     actAnimation=0;
+    active = false;
+    nextActive = 0;
 }
 
 
@@ -255,6 +440,7 @@ PieceWidget::PieceWidget( int _freq, int bFr, QWidget *parent )
 
     freq = _freq;
     isRunning = false;
+    activeList = 0;
     pieceFraction = bFr;
     realSize = -1;
     timer = new QTimer(this);
@@ -283,10 +469,25 @@ void PieceWidget::createPiecePosition(int no, int x, int y, Piece* def)
 {
     if (no<0 || no>= MAX_POSITION) return;
 
-    if (positions[no] !=0)
+    if (positions[no] !=0) {
+	removeActive(positions[no]);
 	delete positions[no];
+    }
 
-    positions[no] = new PiecePosition(x,y, def);
+    positions[no] = new PiecePosition(no, x,y, def);
+}
+
+void PieceWidget::removeActive(PiecePosition* p)
+{
+    PiecePosition** pp;
+
+    if (!p->active) return;
+    for(pp = &activeList; *pp != 0; pp = &(*pp)->nextActive)
+	if (*pp == p) {
+	    *pp = p->nextActive;
+	    break;
+	}
+    p->active = false;
 }
 
 void PieceWidget::startAnimation(int pos, int anim, int type)
@@ -304,6 +505,12 @@ void PieceWidget::startAnimation(int pos, int anim, int type)
     p->actDir = 1;
     p->actType = type;
 
+    if (!p->active) {
+	p->active = true;
+	p->nextActive = activeList;
+	activeList = p;
+    }
+
     if (!isRunning) {
 	isRunning = true;
 	timer->setSingleShot(true);
@@ -342,28 +549,35 @@ void PieceWidget::resizeEvent(QResizeEvent *)
     update();
 }
 
-void PieceWidget::paintEvent(QPaintEvent *)
+void PieceWidget::paintEvent(QPaintEvent *e)
 {
     QPainter p(this);
-    drawPieces(&p);
+    drawPieces(&p, e->region());
+}
+
+QRect PieceWidget::pieceRect(PiecePosition* p)
+{
+    return QRect( (width() + p->x * realSize / 500 - Piece::w() )/2,
+		  (height() + p->y * realSize / 500 - Piece::h() )/2,
+		  Piece::w()+1, Piece::h()+1 );
 }
 
-void PieceWidget::drawPieces(QPainter* painter)
+void PieceWidget::drawPieces(QPainter* painter, const QRegion& r)
 {
     int i;
     PiecePosition *pos;
     int xReal, yReal;
 
-    int w = width(), h = height();
-
     if (realSize<0) return;
 
     for(i=0;i<MAX_POSITION;i++) {
 	pos = positions.at(i);
 	if (pos==0) continue;
 
-	xReal = (w + pos->x * realSize / 500 - Piece::w() )/2;
-	yReal = (h + pos->y * realSize / 500 - Piece::h() )/2;
+	QRect pr = pieceRect(pos);
+	if (!r.isEmpty() && !r.intersects(pr)) continue;
+	xReal = pr.x();
+	yReal = pr.y();
 
 	if (pos->actAnimation==0 || pos->actStep==-1) {
 	    if (pos->def !=0 ) {
@@ -380,61 +594,59 @@ void PieceWidget::drawPieces(QPainter* painter)
     }
 }
 
+/* Advance running animations: only positions in the active list are
+ * visited, and the union of their rectangles is repainted */
 void PieceWidget::animate()
 {
-    bool doAnimation = false;
-
-    int i;
-    PiecePosition *p;
-    int xReal, yReal;
-
-    int w = width(), h = height();
-
-    for(i=0;i<MAX_POSITION;i++) {
-	p = positions.at(i);
-	if (p==0) continue;
+    PiecePosition *p, **pp;
+    QRegion dirty;
 
+    pp = &activeList;
+    while((p = *pp) != 0) {
 	if (p->actType == ANIMATION_STOPPED ||
-	    p->actAnimation ==0) continue;
+	    p->actAnimation ==0) {
+	    *pp = p->nextActive;
+	    p->active = false;
+	    continue;
+	}
 
 	p->actStep += p->actDir;
 	if (p->actStep <= -1) {
 	    p->actDir = 1;
 	    p->actStep = 1;
-	    doAnimation = true;
 	}
 	else if (p->actStep >= p->actAnimation->steps) {
 	    if (p->actType == ANIMATION_CYCLE) {
 		p->actDir = -1;
 		p->actStep = p->actAnimation->steps -2;
-		doAnimation = true;
 	    }
 	    else if (p->actType == ANIMATION_LOOP) {
 		p->actStep = 1; /*skip first frame for smooth animation */
-		doAnimation = true;
 	    }
 	    else {
 		p->actType = ANIMATION_STOPPED;
 		p->actAnimation = 0;
-		emit animationFinished(i);
+		if (p->def !=0)
+		    dirty += pieceRect(p);
+
+		/* unlink before the signal: slots may start animations,
+		 * which puts positions (also <p>) at head of the list */
+		*pp = p->nextActive;
+		p->active = false;
+		emit animationFinished(p->no);
+		continue;
 	    }
 	}
-	else {
-	    doAnimation = true;
-	}
 
-	xReal = (w + p->x * realSize / 500 - Piece::w() )/2;
-	yReal = (h + p->y * realSize / 500 - Piece::h() )/2;
+	if (p->actAnimation !=0 || p->def !=0)
+	    dirty += pieceRect(p);
+	pp = &p->nextActive;
+    }
 
-	if (p->actAnimation==0 || p->actStep==-1) {
-	    if (p->def !=0 )
-		update( xReal, yReal, Piece::w()+1, Piece::h()+1);
-	}
-	else
-	    update( xReal, yReal, Piece::w()+1, Piece::h()+1);
+    if (!dirty.isEmpty())
+	update(dirty);
 
-    }
-    if (!doAnimation) {
+    if (activeList == 0) {
 	isRunning = false;
 	emit animationsFinished();
     }
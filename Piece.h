@@ -25,9 +25,11 @@
 #define _PIECE_H_
 
 #include <QPixmap>
+#include <QImage>
 #include <QColor>
 #include <QWidget>
 #include <QList>
+#include <QRegion>
 
 /* textures for pieces */
 #define TEX_FLAT   0
@@ -54,10 +56,27 @@ public:
 			 const QColor& c = QColor(200,230,255) );
     static void setTexture(double c=13., double d=.2);
 
+    /* Rendered pieces are cached in files in directory <d>, by default
+     * in the user's cache directory. No disk cache if <d> is empty */
+    static void setCacheDir(const QString& d);
+
 private:
-    void render();
+    friend class PieceRenderer;
+
+    /* render all invalidated pieces in parallel */
+    static void renderAll();
+    QImage renderImage() const;
     static void invalidate();
 
+    /* disk cache */
+    enum { CacheVersion = 1, MaxCacheSize = 32*1024*1024 };
+    QString cacheFile() const;
+    bool loadCached(const QString& file);
+    bool saveCached(const QString& file) const;
+    static void pruneCache();
+    static QString cacheDir;
+    static bool cacheDirSet;
+
     //static QImage back;
     static int sizeX, sizeY;
     static double lightX, lightY, lightZ;
@@ -65,6 +84,8 @@ private:
     static double rippleCount, rippleDepth;
 
     QPixmap pm;
+    QImage image;     /* rendered or loaded by a worker thread */
+    bool saved;       /* image was added to disk cache */
     QColor bColor;
     double an, sina, cosa;
     int tex;
@@ -93,11 +114,15 @@ public:
 
 class PiecePosition {
 public:
-    PiecePosition(int xp,int yp, Piece* d);
+    PiecePosition(int n, int xp,int yp, Piece* d);
 
-    int x, y, actStep, actDir, actType;
+    int no, x, y, actStep, actDir, actType;
     Piece* def;
     PieceAnimation* actAnimation;
+
+    /* list of positions with running animation */
+    bool active;
+    PiecePosition* nextActive;
 };
 
 #define MAX_POSITION  130
@@ -125,7 +150,9 @@ signals:
     void animationsFinished(void);
 
 protected:
-    void drawPieces(QPainter*);
+    /* draw pieces intersecting <r>, all if <r> is empty */
+    void drawPieces(QPainter*, const QRegion& r = QRegion());
+    QRect pieceRect(PiecePosition*);
 
 private slots:
     void animate();
@@ -135,6 +162,9 @@ protected:
     QVector<PieceAnimation*> animations;
 
 private:
+    void removeActive(PiecePosition*);
+
+    PiecePosition* activeList;
     int freq;
     int xStart, yStart, realSize, pieceFraction;
     bool isRunning;
@@ -0,0 +1,186 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Search for best move in a separate thread */
+
+#include "SearchThread.h"
+
+SearchThread::SearchThread(QObject* parent)
+    : QThread(parent)
+{
+    _searchId = _runningId = 0;
+    _searching = false;
+    _stopRequested = false;
+    _predictionKey = 0;
+    _pondering = _ponderDone = false;
+    _ponderKey = 0;
+    _hitRequested = false;
+
+    qRegisterMetaType<Move>("Move");
+
+    /* Called from the search thread while searching */
+    _board.setCallback(this);
+
+    /* Sent from the search thread, received in our thread */
+    connect(this, SIGNAL(searchProgress(Move,int,int)),
+	    this, SLOT(deliverProgress(Move,int,int)), Qt::QueuedConnection);
+    connect(this, SIGNAL(searchDone(Move,int)),
+	    this, SLOT(deliverMove(Move,int)), Qt::QueuedConnection);
+}
+
+SearchThread::~SearchThread()
+{
+    cancelSearch();
+}
+
+void SearchThread::startSearch(const Board& b, const SearchLimits& l)
+{
+    cancelSearch();
+
+    _board.setPosition(b);
+    startThread(l);
+}
+
+bool SearchThread::startPonder(const Board& b, const SearchLimits& l)
+{
+    cancelSearch();
+
+    if (!_prediction.isValid() || b.hashKey() != _predictionKey)
+	return false;
+
+    _board.setPosition(b);
+    _board.playMove(_prediction);
+    _ponderMove = _prediction;
+    _ponderKey = _board.hashKey();
+    _pondering = true;
+    _ponderDone = false;
+
+    SearchLimits pl = l;
+    pl.ponder = true;
+    startThread(pl);
+    return true;
+}
+
+bool SearchThread::ponderHit(const Board& b, const SearchLimits& l)
+{
+    if (!_pondering || b.hashKey() != _ponderKey) {
+	cancelSearch();
+	return false;
+    }
+
+    _pondering = false;
+    if (_ponderDone) {
+	/* deliver as usual, via the event loop */
+	emit searchDone(_ponderResult, _searchId);
+	return true;
+    }
+
+    /* handed over to search thread in searchBreak() */
+    QMutexLocker lock(&_hitMutex);
+    _hitLimits = l;
+    _hitRequested = true;
+    return true;
+}
+
+void SearchThread::startThread(const SearchLimits& l)
+{
+    _limits = l;
+    _hitRequested = false;
+    _prediction = Move();
+    _runningId = ++_searchId;
+    _searching = true;
+    _stopRequested = false;
+    start();
+}
+
+void SearchThread::stopSearch()
+{
+    if (!isRunning()) return;
+
+    /* If the search is just starting, the break flag may get reset:
+     * it is set again on next searchBreak() */
+    _stopRequested = true;
+    _board.stopSearch();
+}
+
+void SearchThread::cancelSearch()
+{
+    /* results of the cancelled search will be ignored */
+    _searchId++;
+    _pondering = false;
+    if (isRunning()) {
+	stopSearch();
+	wait();
+    }
+
+    if (_searching) {
+	_searching = false;
+	emit cancelled();
+    }
+}
+
+void SearchThread::run()
+{
+    Move m = _board.bestMove(_limits);
+
+    /* for startPonder() */
+    if (m.isValid() && _board.nextMove().isValid()) {
+	_prediction = _board.nextMove();
+	_board.playMove(m);
+	_predictionKey = _board.hashKey();
+	_board.takeBack();
+    }
+    emit searchDone(m, _runningId);
+}
+
+void SearchThread::searchBreak()
+{
+    if (_stopRequested)
+	_board.stopSearch();
+    if (_hitRequested) {
+	QMutexLocker lock(&_hitMutex);
+	_board.ponderHit(_hitLimits);
+	_hitRequested = false;
+    }
+}
+
+void SearchThread::bestMoveUpdated(const Move& m, int value)
+{
+    emit searchProgress(m, value, _runningId);
+}
+
+void SearchThread::deliverProgress(Move m, int value, int id)
+{
+    if (id != _searchId || _pondering) return;
+
+    emit progress(m, value);
+}
+
+void SearchThread::deliverMove(Move m, int id)
+{
+    if (id != _searchId) return;
+
+    if (_pondering) {
+	/* wait for ponderHit() */
+	_ponderDone = true;
+	_ponderResult = m;
+	return;
+    }
+    _searching = false;
+    emit moveFound(m);
+}
@@ -0,0 +1,138 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Search for best move in a separate thread
+ *
+ * The search runs on a copy of the position given to startSearch().
+ * Results are delivered via signals to the thread this object
+ * lives in (usually the GUI thread).
+ *
+ * Pondering: while the opponent is thinking, startPonder() searches
+ * the reply predicted by the last search. If the opponent plays it,
+ * ponderHit() lets this search go on. Otherwise, it is cancelled;
+ * the transposition table still helps the next search.
+ */
+
+#ifndef _SEARCHTHREAD_H_
+#define _SEARCHTHREAD_H_
+
+#include <QThread>
+#include <QMutex>
+
+#include "Board.h"
+
+class SearchThread : public QThread, private SearchCallback
+{
+    Q_OBJECT
+
+public:
+    SearchThread(QObject* parent = 0);
+    ~SearchThread();
+
+    /* Start search on copy of <b>. A running search is cancelled */
+    void startSearch(const Board& b, const SearchLimits& l);
+    void startSearch(const Board& b, int depth)
+    { SearchLimits l; l.depth = depth; startSearch(b, l); }
+
+    /* Stop search as fast as possible: the best move found so far
+     * is delivered with moveFound() */
+    void stopSearch();
+
+    /* Stop search without delivering a result */
+    void cancelSearch();
+
+    /* Search position <b> after the opponent's move predicted by the
+     * last search, if <b> is the position this search was done for
+     * after playing its result. Limits <l> (but depth) only apply
+     * after ponderHit(). Returns false without prediction */
+    bool startPonder(const Board& b, const SearchLimits& l);
+
+    /* To be called instead of startSearch(): if pondering on <b>,
+     * the search continues with limits <l> counting from now, and
+     * true is returned. Otherwise, pondering is cancelled */
+    bool ponderHit(const Board& b, const SearchLimits& l);
+
+    bool isPondering() { return _pondering; }
+    /* opponent's move expected while pondering */
+    Move ponderMove() { return _ponderMove; }
+
+    /* Threads used by following searches */
+    void setThreads(int n) { _board.setThreads(n); }
+    /* Settings of board used for searching, see Board */
+    void setHashSize(int mb) { _board.setHashSize(mb); }
+    void setNullMove(int r, bool verify) { _board.setNullMove(r, verify); }
+    void setLateMoveReduction(int m) { _board.setLateMoveReduction(m); }
+    void setBook(const OpeningBook* b) { _board.setBook(b); }
+    void setDeterministic(bool on, quint64 seed)
+    { _board.setDeterministic(on, seed); }
+    void setSpyLevel(int l) { _board.setSpyLevel(l); }
+
+    /* search calls of last search; only valid when not searching */
+    qint64 nodes() const { return _board.nodes(); }
+
+    bool isSearching() { return _searching; }
+
+signals:
+    /* new best move at root of search */
+    void progress(Move m, int value);
+    void moveFound(Move m);
+    void cancelled();
+
+    /* internal: results of search with given id */
+    void searchProgress(Move m, int value, int id);
+    void searchDone(Move m, int id);
+
+protected:
+    virtual void run();
+
+private:
+    /* SearchCallback, called in the search thread */
+    virtual void searchBreak();
+    virtual void bestMoveUpdated(const Move& m, int value);
+
+private slots:
+    void deliverProgress(Move m, int value, int id);
+    void deliverMove(Move m, int id);
+
+private:
+    void startThread(const SearchLimits& l);
+
+    Board _board;
+    SearchLimits _limits;
+    int _searchId, _runningId;
+    bool _searching;
+    AtomicFlag _stopRequested;
+
+    /* reply predicted by last search, and key of the position
+     * after the move found */
+    Move _prediction;
+    quint64 _predictionKey;
+
+    bool _pondering;
+    Move _ponderMove;
+    quint64 _ponderKey;
+    bool _ponderDone;              /* search finished before hit */
+    Move _ponderResult;
+    /* handed over to the search thread, protected by _hitMutex */
+    QMutex _hitMutex;
+    SearchLimits _hitLimits;
+    AtomicFlag _hitRequested;
+};
+
+#endif /* _SEARCHTHREAD_H_ */
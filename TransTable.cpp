@@ -0,0 +1,149 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Transposition table for the alpha/beta search */
+
+#include "TransTable.h"
+
+/* Layout of data word of a slot */
+enum { valueShift = 0, fieldShift = 16, dirShift = 24, typeShift = 27,
+       depthShift = 31, boundShift = 39, ageShift = 41 };
+
+quint64 TransTable::pack(const TransEntry& e)
+{
+    return ((quint64)(quint16) e.value              << valueShift) |
+	   ((quint64)(e.move.field & 0xff)          << fieldShift) |
+	   ((quint64)(e.move.direction & 7)         << dirShift)   |
+	   ((quint64)(e.move.type & 15)             << typeShift)  |
+	   ((quint64)((e.depth + 128) & 0xff)       << depthShift) |
+	   ((quint64)(e.bound & 3)                  << boundShift) |
+	   ((quint64)(e.age & 63)                   << ageShift);
+}
+
+void TransTable::unpack(quint64 d, TransEntry& e)
+{
+    e.value = (short)(quint16)(d >> valueShift);
+    e.move.field = (d >> fieldShift) & 0xff;
+    e.move.direction = (d >> dirShift) & 7;
+    e.move.type = (Move::MoveType)((d >> typeShift) & 15);
+    e.depth = (int)((d >> depthShift) & 0xff) - 128;
+    e.bound = (d >> boundShift) & 3;
+    e.age = (d >> ageShift) & 63;
+}
+
+TransTable::TransTable(int mb)
+{
+    _slot = 0;
+    _mask = 0;
+    _size = 0;
+    _age = 0;
+    setSize(mb);
+}
+
+TransTable::~TransTable()
+{
+    delete [] _slot;
+}
+
+void TransTable::setSize(int mb)
+{
+    quint64 count = 1;
+
+    delete [] _slot;
+    _slot = 0;
+    _mask = 0;
+    _size = (mb>0) ? mb : 0;
+    if (_size == 0) return;
+
+    /* largest power of 2 number of entries fitting into <mb> */
+    while(2 * count * sizeof(Slot) <= (quint64)_size * 1024 * 1024)
+	count *= 2;
+
+    _slot = new Slot[count];
+    _mask = count - 1;
+    clear();
+}
+
+void TransTable::clear()
+{
+    if (!_slot) return;
+
+    /* bound none: never matches */
+    for(quint64 i=0; i<=_mask; i++)
+	_slot[i].store(0, 0);
+}
+
+void TransTable::newSearch()
+{
+    /* the age is stored in 6 bits: after 64 searches, entries of an
+     * old search (with values of another evaluation) would look like
+     * current ones */
+    _age = (_age+1) & 63;
+    if (_age == 0)
+	clear();
+}
+
+bool TransTable::probe(quint64 key, TransEntry& e)
+{
+    if (!_slot) return false;
+
+    /* read slot only once, it may be changed concurrently */
+    Slot& s = _slot[key & _mask];
+    quint64 data = s.loadData();
+    if ((s.loadCheck() ^ data) != key)
+	return false;
+
+    unpack(data, e);
+    if (e.bound == TransEntry::none) return false;
+
+    /* value may be from another evaluation (rotated after each search,
+     * see Board::changeEvaluation): only the move is still useful */
+    if (e.age != _age)
+	e.bound = TransEntry::none;
+    return true;
+}
+
+void TransTable::store(quint64 key, int depth, int bound,
+		       int value, const Move& m)
+{
+    if (!_slot) return;
+
+    Slot& s = _slot[key & _mask];
+    quint64 data = s.loadData();
+    bool sameKey = ((s.loadCheck() ^ data) == key);
+    TransEntry e;
+
+    unpack(data, e);
+
+    /* Depth preferred replacement; entries of old searches are
+     * always replaced */
+    if (!sameKey && e.bound != TransEntry::none &&
+	e.age == _age && e.depth > depth)
+	return;
+
+    /* keep an old best move if we do not know a better one */
+    if (m.type != Move::none || !sameKey)
+	e.move = m;
+    e.value = value;
+    e.depth = depth;
+    e.bound = bound;
+    e.age = _age;
+
+    data = pack(e);
+    s.store(key ^ data, data);
+}
@@ -0,0 +1,111 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Transposition table for the alpha/beta search
+ *
+ * Fixed size hash table indexed by the Zobrist key of a position
+ * (see Board::hashKey). Stores search depth, bound type, value
+ * and best move of an already searched position.
+ *
+ * Can be shared by multiple search threads without locking: an entry
+ * is stored as two words, with the key XORed into the first one.
+ * An entry partly overwritten by another thread does not match
+ * any key and is ignored.
+ */
+
+#ifndef _TRANSTABLE_H_
+#define _TRANSTABLE_H_
+
+#include <QtGlobal>
+#if QT_VERSION >= 0x050300
+#include <QAtomicInteger>
+#endif
+#include "Move.h"
+
+class TransEntry
+{
+public:
+    /* type of value stored */
+    enum Bound { none = 0, exact, lower, upper };
+
+    int value;
+    int depth;                /* remaining search depth */
+    int bound;
+    int age;
+    Move move;                /* best move */
+};
+
+
+class TransTable
+{
+public:
+    enum { defaultSize = 16 };   /* in MB */
+
+    TransTable(int mb = defaultSize);
+    ~TransTable();
+
+    /* Change memory used to <mb> megabytes; 0 disables the table.
+     * This clears all entries */
+    void setSize(int mb);
+    int size() { return _size; }
+    void clear();
+
+    /* To be called at start of each search: prefer replacing
+     * entries from older searches. Clears the table each 64 searches,
+     * when the age wraps around */
+    void newSearch();
+
+    /* Returns false if position with <key> is not found.
+     * For entries of earlier searches, bound is none: use move only */
+    bool probe(quint64 key, TransEntry& e);
+    void store(quint64 key, int depth, int bound, int value, const Move& m);
+
+private:
+    /* Words of a slot are read and written with relaxed atomic
+     * accesses. Without 64 bit atomics in Qt, volatile words are
+     * used: a partly written entry is caught by the check word */
+    class Slot
+    {
+    public:
+#if QT_VERSION >= 0x050300
+	QAtomicInteger<quint64> check;    /* key ^ data */
+	QAtomicInteger<quint64> data;
+
+	quint64 loadCheck() const { return check.load(); }
+	quint64 loadData() const { return data.load(); }
+	void store(quint64 c, quint64 d) { data.store(d); check.store(c); }
+#else
+	volatile quint64 check;           /* key ^ data */
+	volatile quint64 data;
+
+	quint64 loadCheck() const { return check; }
+	quint64 loadData() const { return data; }
+	void store(quint64 c, quint64 d) { data = d; check = c; }
+#endif
+    };
+
+    static quint64 pack(const TransEntry&);
+    static void unpack(quint64 data, TransEntry&);
+
+    Slot* _slot;
+    quint64 _mask;
+    int _size, _age;
+};
+
+#endif /* _TRANSTABLE_H_ */
@@ -0,0 +1,18 @@
+# Benchmark of move generation, evaluation and search (see Bench.cpp)
+
+TEMPLATE = app
+TARGET = qenolaba-bench
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+HEADERS += Move.h Board.h EvalScheme.h TransTable.h BitBoard.h \
+    OpeningBook.h
+
+SOURCES += Move.cpp Board.cpp EvalScheme.cpp TransTable.cpp BitBoard.cpp \
+    OpeningBook.cpp Bench.cpp
+
+# same build options as qenolaba.pro
+bitboard {
+    DEFINES += BITBOARD
+}
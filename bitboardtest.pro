@@ -0,0 +1,16 @@
+# Checks bitboard move generation against the board array variant
+# (see BitBoard.cpp)
+
+TEMPLATE = app
+TARGET = bitboardtest
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+DEFINES += BITBOARD BITBOARD_TEST
+
+HEADERS += Move.h Board.h EvalScheme.h TransTable.h BitBoard.h \
+    OpeningBook.h
+
+SOURCES += Move.cpp Board.cpp EvalScheme.cpp TransTable.cpp BitBoard.cpp \
+    OpeningBook.cpp
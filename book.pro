@@ -0,0 +1,18 @@
+# Generates an opening book by self-play (see bookmain.cpp)
+
+TEMPLATE = app
+TARGET = qenolaba-book
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+HEADERS += Move.h Board.h EvalScheme.h TransTable.h BitBoard.h \
+    OpeningBook.h
+
+SOURCES += Move.cpp Board.cpp EvalScheme.cpp TransTable.cpp BitBoard.cpp \
+    OpeningBook.cpp bookmain.cpp
+
+# same build options as qenolaba.pro
+bitboard {
+    DEFINES += BITBOARD
+}
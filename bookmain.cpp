@@ -0,0 +1,90 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+
+/* Generates an opening book by self-play (see OpeningBook.h).
+ *
+ * Each game starts with a random rotation of the field values (see
+ * Board::changeEvaluation) for variety. The moves of the first
+ * <plies> half-moves are stored, weighted by how often they were
+ * chosen in a position.
+ *
+ * Usage: qenolaba-book <file> [games] [plies] [depth]
+ */
+
+#include <QElapsedTimer>
+#include <QVector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Board.h"
+#include "OpeningBook.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+	fprintf(stderr, "Usage: %s <file> [games] [plies] [depth]\n",
+		argv[0]);
+	return 1;
+    }
+    int games = (argc>2) ? atoi(argv[2]) : 100;
+    int plies = (argc>3) ? atoi(argv[3]) : 16;
+    int depth = (argc>4) ? atoi(argv[4]) : 4;
+
+    QVector<BookEntry> list;
+    QElapsedTimer timer;
+    Board b;
+    int g, i;
+
+    b.setEvalScheme();
+    b.setSpyLevel(0);
+    b.setDepth(depth);
+    timer.start();
+
+    for(g = 0; g < games; g++) {
+	for(i = qrand() % 72; i > 0; i--)
+	    b.changeEvaluation();
+
+	b.begin((g & 1) ? Board::color2 : Board::color1);
+	for(i = 0; i < plies; i++) {
+	    BookEntry e;
+	    e.key = b.hashKey();
+	    e.move = b.bestMove();
+	    e.weight = 1;
+	    if (e.move.type == Move::none) break;
+
+	    list.append(e);
+	    b.playMove(e.move);
+	    if (!b.isValid()) break;
+	}
+	fprintf(stderr, "Game %d of %d, %d s\r", g+1, games,
+		(int) (timer.elapsed() / 1000));
+    }
+    fprintf(stderr, "\n");
+
+    if (!OpeningBook::write(argv[1], list)) {
+	fprintf(stderr, "Error writing %s\n", argv[1]);
+	return 1;
+    }
+
+    OpeningBook book;
+    book.open(argv[1]);
+    printf("%s: %d moves\n", argv[1], book.size());
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+# Engine without GUI, driven by a line based protocol on stdin/stdout
+# (see Engine.h)
+
+TEMPLATE = app
+TARGET = qenolaba-engine
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+HEADERS += Move.h Board.h EvalScheme.h TransTable.h BitBoard.h \
+    OpeningBook.h SearchThread.h Engine.h
+
+SOURCES += Move.cpp Board.cpp EvalScheme.cpp TransTable.cpp BitBoard.cpp \
+    OpeningBook.cpp SearchThread.cpp Engine.cpp enginemain.cpp
+
+# same build options as qenolaba.pro
+bitboard {
+    DEFINES += BITBOARD
+}
@@ -0,0 +1,36 @@
+/* This file is part of Qenolaba.
+   Copyright (C) 2015 Josef Weidendorfer <Josef.Weidendorfer@gmx.de>
+
+   Qenolaba is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Startup of engine without GUI */
+
+#include <QCoreApplication>
+
+#include "Engine.h"
+
+int main( int argc, char ** argv )
+{
+    QCoreApplication app(argc, argv);
+
+    QCoreApplication::setOrganizationName("qenolaba.github.io");
+    QCoreApplication::setApplicationName("Qenolaba Engine");
+
+    Engine e;
+    e.start();
+
+    return app.exec();
+}
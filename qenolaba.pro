@@ -6,10 +6,25 @@ greaterThan(QT_MAJOR_VERSION, 4) {
 
 RESOURCES = qenolaba.qrc
 
-HEADERS += Move.h Board.h EvalScheme.h  \
+HEADERS += Move.h Board.h EvalScheme.h TransTable.h \
     Piece.h BoardWidget.h Network.h \
-    MainWindow.h
+    MainWindow.h SearchThread.h BitBoard.h OpeningBook.h
 
-SOURCES += Move.cpp Board.cpp EvalScheme.cpp \
+SOURCES += Move.cpp Board.cpp EvalScheme.cpp TransTable.cpp \
     Piece.cpp BoardWidget.cpp Network.cpp \
-    MainWindow.cpp main.cpp
+    MainWindow.cpp SearchThread.cpp BitBoard.cpp OpeningBook.cpp \
+    main.cpp
+
+# use bitboard move generation (qmake CONFIG+=bitboard)
+bitboard {
+    DEFINES += BITBOARD
+}
+
+# let the compiler vectorize piece rendering (Piece::renderImage)
+*-g++* {
+    QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize -fvect-cost-model=dynamic \
+	-fno-math-errno -fno-trapping-math
+}
+*-clang* {
+    QMAKE_CXXFLAGS_RELEASE += -fno-math-errno
+}